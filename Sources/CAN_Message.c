@@ -6,8 +6,42 @@
   * @Descriptiuon: Provides a set of reading and writting soft CAN send and receive
   *                buffers functions.
   * @Others: None
-  * @History: 1. Created by Wangjian.
-  * @version: V1.0.0
+  * @History: 1. Created by Wangjian.                                       (V1.0.0)
+  *           2. Change the soft buffers to single producer/single consumer rings
+  *              with read and write pointers instead of frame type flags.   (V1.0.1)
+  *           3. Serve all channels through one table of buffer descriptors
+  *              indexed by the MSCAN channel number.                        (V1.0.2)
+  *           4. Add a function which reads a batch of received messages.  (V1.0.3)
+  *           5. Send the messages by the transmitter empty interrupts.    (V1.0.4)
+  *           6. Move the consumer of the send buffers to XGATE,CPU core
+  *              only fills the send buffers and triggers XGATE.           (V1.0.5)
+  *           7. Send the messages of a send buffer by the CAN ID priority
+  *              instead of the filling order.                             (V1.0.6)
+  *           8. Store packed CAN frames in the soft buffers.              (V1.0.7)
+  *           9. Add the raw identifier register frame format and the 
+  *              functions which read a packed frame and decode its ID.  (V1.0.8)
+  *          10. Add receive overflow policies,drop counters and high
+  *              water marks.                                              (V1.0.9)
+  *          11. Configure all channels through one table,use power of two
+  *              buffer depths and check the buffer layout at compile time.(V1.1.0)
+  *          12. Use free running ring pointers masked on access.         (V1.1.1)
+  *          13. Add the software acceptance filter which XGATE applies
+  *              before a frame is stored.                                 (V1.1.2)
+  *          14. Add the receive dispatch,which finds the handler of a
+  *              message in a sorted table by binary search.              (V1.1.3)
+  *          15. Add the mailboxes which keep the latest frame of cyclic
+  *              messages instead of queuing every repetition.            (V1.1.4)
+  *          16. Add the receive time stamp of every frame.               (V1.1.5)
+  *          17. Add the queue latency statistic of the send buffers.     (V1.1.6)
+  *          18. Add the RTI driven cyclic message schedule.              (V1.1.7)
+  *          19. Wake the receive tasks by the XGATE receive events.      (V1.1.8)
+  *          20. Count the receive handler entries per frame.             (V1.1.9)
+  *          21. Take the time stamps from the microsecond system time.   (V1.2.0)
+  *          22. Register the frame types of the receive handlers.        (V1.2.1)
+  *          23. Turn the frame time stamp off by default.                (V1.2.2)
+  *          24. Clear the payload of cyclic messages,refuse the channels
+  *              of the cyclic schedule in Fill_CANSendBuffer().          (V1.2.3)
+  * @version: V1.2.3
   * @date:    26-Sep-2015
 
   ******************************************************************************
@@ -29,6 +63,7 @@
   */
 
 #include "CAN_Message.h"
+#include "System_Driver.h"
 #include "xgate.h"
 
 
@@ -38,403 +73,1103 @@
 
 volatile CANSendMessagebuffer_TypeDef g_CANx_SendBuffer;
 
+volatile CANSoftFilter_TypeDef g_CAN_SoftFilter;
+
+volatile CANMailboxTable_TypeDef g_CAN_Mailbox;
+
 #pragma DATA_SEG DEFAULT
 
 
 
+/* Soft CAN buffer configuration of each channel,indexed by MSCAN_ChannelTypeDef */
+static const CANChannelConfig_TypeDef CAN_ChannelConfig[CAN_CHANNEL_NUM] = 
+{
+    /* receive_size             send_size               policy          soft_filter */
+    {INTRANET_RECEIVEBUF_SIZE,  INTRANET_SENDBUF_SIZE,  CAN_DropNewest, CAN_SoftFilterOff},      /* MSCAN_Channel0: system intranet */
+    {ECU_RECEIVEBUF_SIZE,       ECU_SENDBUF_SIZE,       CAN_DropNewest, CAN_SoftFilterOff},      /* MSCAN_Channel1: ECU */
+    {CHARGER_RECEIVEBUF_SIZE,   CHARGER_SENDBUF_SIZE,   CAN_DropNewest, CAN_SoftFilterJ1939},    /* MSCAN_Channel4: charger */
+};
+
+
+
+/* Accept list of the software acceptance filter,only used by the channels whose soft_filter is not CAN_SoftFilterOff */
+static const CANAcceptId_TypeDef CAN_AcceptList[] = 
+{
+    /* ch               id_format             id */
+    {MSCAN_Channel4,    OnlyAcceptExtendedID, 0x18901212u},     /* Charger status,PGN 0x09000 */
+};
+
+
+
+/* Mailbox list,the data frames of these IDs are kept in mailboxes instead of the receive buffers */
+static const CANAcceptId_TypeDef CAN_MailboxList[] = 
+{
+    /* ch               id_format             id */
+    {MSCAN_Channel1,    OnlyAcceptExtendedID, 0x0CF00400u},     /* ECU engine speed,cyclic */
+};
+
+
+
+/* Payload of the charger control message */
+static const uint8_t Charger_ControlData[8] = {0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x29};
+
+
+/* Cyclic message schedule,the periods and offsets are given in RTI ticks */
+static const CANCyclicMessage_TypeDef CAN_CyclicTable[] = 
+{
+    /* ch               frametype                 id           period  offset                  dlc  data                 callback */
+    {MSCAN_Channel4,    DataFrameWithExtendedId,  0x18F09234u, 25,     CAN_CYCLIC_AUTO_OFFSET, 8,   Charger_ControlData, NULL},     /* Charger control */
+};
+
+
+/* Ticks until the next send of each cyclic message */
+static uint16_t CAN_CyclicCount[CAN_CYCLIC_NUM];
+
+/* Bit n is set when the send buffer of channel n is filled by the cyclic schedule */
+static uint8_t CAN_CyclicChannels;
+
+
+
+/* Task of each channel which is triggered by the receive events,-1 if there is none */
+static int16_t CAN_ReceiveTask[CAN_CHANNEL_NUM];
+
+
+
+/* Registered handlers sorted by key_low,and the number of them */
+static CANDispatchEntry_TypeDef CAN_DispatchTable[CAN_DISPATCH_SIZE];
+
+static uint8_t CAN_DispatchNum = 0;
+
+
+
+/* Compile time check,the array size becomes negative and the compiler stops when the condition is false. */
+#define   CAN_STATIC_ASSERT(name, cond)    typedef char CAN_StaticAssert_##name[(cond) ? 1 : -1]
+
+/* A buffer depth must be a power of two from 2 to 128 */
+#define   CAN_VALID_DEPTH(n)               (((n) >= 2) && ((n) <= 128) && (((n) & ((n) - 1)) == 0))
+
+/* PAGED_RAM of prm/Project.prm consists of the pages RAM_FC and RAM_FD,one buffer object can not cross a page. */
+#define   CAN_PAGED_RAM_PAGE_SIZE          (0x1000u)
+#define   CAN_PAGED_RAM_PAGE_NUM           (2u)
+
+CAN_STATIC_ASSERT(IntranetReceiveDepth, CAN_VALID_DEPTH(INTRANET_RECEIVEBUF_SIZE));
+CAN_STATIC_ASSERT(EcuReceiveDepth,      CAN_VALID_DEPTH(ECU_RECEIVEBUF_SIZE));
+CAN_STATIC_ASSERT(ChargerReceiveDepth,  CAN_VALID_DEPTH(CHARGER_RECEIVEBUF_SIZE));
+CAN_STATIC_ASSERT(IntranetSendDepth,    CAN_VALID_DEPTH(INTRANET_SENDBUF_SIZE));
+CAN_STATIC_ASSERT(EcuSendDepth,         CAN_VALID_DEPTH(ECU_SENDBUF_SIZE));
+CAN_STATIC_ASSERT(ChargerSendDepth,     CAN_VALID_DEPTH(CHARGER_SENDBUF_SIZE));
+
+/* The slot index base + index is 8 bits wide */
+CAN_STATIC_ASSERT(ReceivePoolIndex,     CAN_RECEIVEBUF_TOTAL <= 256);
+CAN_STATIC_ASSERT(SendPoolIndex,        CAN_SENDBUF_TOTAL <= 256);
+
+/* XGATE accesses words at even addresses only */
+CAN_STATIC_ASSERT(FrameAlignment,       (sizeof(CANFrame_TypeDef) & 1u) == 0);
+
+CAN_STATIC_ASSERT(SoftFilterHashSize,   CAN_VALID_DEPTH(CAN_SOFTFILTER_HASH_SIZE));
+CAN_STATIC_ASSERT(SoftFilterAlignment,  (sizeof(CANSoftFilter_TypeDef) & 1u) == 0);
+
+CAN_STATIC_ASSERT(MailboxNum,           sizeof(CAN_MailboxList) / sizeof(CAN_MailboxList[0]) <= CAN_MAILBOX_NUM);
+CAN_STATIC_ASSERT(MailboxAlignment,     (sizeof(CANMailboxTable_TypeDef) & 1u) == 0);
+
+CAN_STATIC_ASSERT(CyclicNum,            sizeof(CAN_CyclicTable) / sizeof(CAN_CyclicTable[0]) <= CAN_CYCLIC_NUM);
+
+CAN_STATIC_ASSERT(SendStatAlignment,    (sizeof(CANSendStatistic_TypeDef) & 1u) == 0);
+
+CAN_STATIC_ASSERT(ReceiveBufferPage,    sizeof(CANReceiveMessageBuffer_TypeDef) <= CAN_PAGED_RAM_PAGE_SIZE);
+CAN_STATIC_ASSERT(SendBufferPage,       sizeof(CANSendMessagebuffer_TypeDef) <= CAN_PAGED_RAM_PAGE_SIZE);
+CAN_STATIC_ASSERT(SoftFilterPage,       sizeof(CANSoftFilter_TypeDef) <= CAN_PAGED_RAM_PAGE_SIZE);
+CAN_STATIC_ASSERT(MailboxPage,          sizeof(CANMailboxTable_TypeDef) <= CAN_PAGED_RAM_PAGE_SIZE);
+CAN_STATIC_ASSERT(PagedRamSize,         sizeof(CANReceiveMessageBuffer_TypeDef) + sizeof(CANSendMessagebuffer_TypeDef)
+                                        + sizeof(CANSoftFilter_TypeDef) + sizeof(CANMailboxTable_TypeDef)
+                                        <= CAN_PAGED_RAM_PAGE_SIZE * CAN_PAGED_RAM_PAGE_NUM);
+
+
+
 
 /**
- * @brief   Check the CAN received buffers and judge if there is a valid CAN messages.If yes,get them out.
- * @param   CANx, CAN channel number.
- *          *CAN_RMessage, Store the read CAN message data buffer.
- * @returns 0: There is a valid CAN message and get it out from CAN receive buffer.Calling succeeded.
- * 			-1: There is not a valid CAN message.Calling failed.
+ * @brief   Pack a CAN message into the frame format of the soft CAN buffers.
+ * @param   *CAN_Message, The CAN message.
+ *          *frame, The packed frame.
+ * @returns 0: Calling succeeded.
+ * 			-1: Calling failed.The frame type,the data length or the ID is invalid.
  */
-int16_t Check_CANReceiveBuffer(MSCAN_ChannelTypeDef CANx, MSCAN_MessageTypeDef* CAN_RMessage) 
+static int16_t CAN_PackFrame(MSCAN_MessageTypeDef* CAN_Message, volatile CANFrame_TypeDef* frame) 
 {
     uint8_t i;
     
-    if ((CANx < MSCAN_Channel0) || (CANx > MSCAN_Channel4))return -1;
+    uint32_t id = CAN_Message->frame_id;
     
-    if (NULL == CAN_RMessage)return -1;
+    if (CAN_Message->data_length > 8)return -1;
     
-    /* If select CAN0,it means that check system intranet CAN receive buffer. */
-    if (MSCAN_Channel0 == CANx) 
+    if ((CAN_Message->frametype == DataFrameWithStandardId)
+     || (CAN_Message->frametype == RemoteFrameWithStandardId)) 
     {
-        if (g_CANx_RecBuffer.Intranet_RecBuff_RPointer >= INTRANET_RECEIVEBUF_SIZE) 
-        {
-            g_CANx_RecBuffer.Intranet_RecBuff_RPointer = 0;    
-        }
-    
-        /* If the frame type value of intranet CAN received message is zero,that means the current 
-           received buffer is empty. */
-        if (g_CANx_RecBuffer.Intranet_RecBuf[g_CANx_RecBuffer.Intranet_RecBuff_RPointer].frametype == (MSCAN_FrameAndIDTypeDef)0)   
-        {        
-            return -1;        
-        } 
-        else /* If the frame type value is not zero,that means there is a valid CAN message in the current received buffer. */
-        {
-            CAN_RMessage->frametype   = g_CANx_RecBuffer.Intranet_RecBuf[g_CANx_RecBuffer.Intranet_RecBuff_RPointer].frametype;
-            g_CANx_RecBuffer.Intranet_RecBuf[g_CANx_RecBuffer.Intranet_RecBuff_RPointer].frametype   = (MSCAN_FrameAndIDTypeDef)0;
-            
-            CAN_RMessage->frame_id    = g_CANx_RecBuffer.Intranet_RecBuf[g_CANx_RecBuffer.Intranet_RecBuff_RPointer].frame_id;
-            g_CANx_RecBuffer.Intranet_RecBuf[g_CANx_RecBuffer.Intranet_RecBuff_RPointer].frame_id    = 0;
-            
-            if ((CAN_RMessage->frametype == DataFrameWithStandardId)
-             || (CAN_RMessage->frametype == DataFrameWithExtendedId)) 
-            {
-                CAN_RMessage->data_length  = g_CANx_RecBuffer.Intranet_RecBuf[g_CANx_RecBuffer.Intranet_RecBuff_RPointer].data_length;
-                g_CANx_RecBuffer.Intranet_RecBuf[g_CANx_RecBuffer.Intranet_RecBuff_RPointer].data_length = 0;
-                
-                for (i = 0; i < CAN_RMessage->data_length; i++) 
-                {
-                    CAN_RMessage->data[i]  = g_CANx_RecBuffer.Intranet_RecBuf[g_CANx_RecBuffer.Intranet_RecBuff_RPointer].data[i];  
-                    g_CANx_RecBuffer.Intranet_RecBuf[g_CANx_RecBuffer.Intranet_RecBuff_RPointer].data[i] = 0;  
-                }       
-            }
-            
-            g_CANx_RecBuffer.Intranet_RecBuff_RPointer++;
-          
-            return 0;
-        }        
+        if (id > 0x7FFu)return -1;
+        
+        id = CAN_FRAME_STD(id, CAN_Message->frametype == RemoteFrameWithStandardId);
     } 
-    else if (MSCAN_Channel1 == CANx) 
+    else if ((CAN_Message->frametype == DataFrameWithExtendedId)
+          || (CAN_Message->frametype == RemoteFrameWithExtendedId)) 
     {
-        if (g_CANx_RecBuffer.ECU_RecBuff_RPointer >= ECU_RECEIVEBUF_SIZE) 
-        {
-            g_CANx_RecBuffer.ECU_RecBuff_RPointer = 0;    
-        }
+        if (id > CAN_FRAME_ID_MASK)return -1;
+        
+        id = CAN_FRAME_EXT(id, CAN_Message->frametype == RemoteFrameWithExtendedId);
+    } 
+    else 
+    {
+        return -1;
+    }
     
-        /* If the frame type value of intranet CAN received message is zero,that means the current 
-           received buffer is empty. */
-        if (g_CANx_RecBuffer.ECU_RecBuf[g_CANx_RecBuffer.ECU_RecBuff_RPointer].frametype == (MSCAN_FrameAndIDTypeDef)0)   
-        {        
-            return -1;        
-        } 
-        else /* If the frame type value is not zero,that means there is a valid CAN message in the current received buffer. */
-        {
-            CAN_RMessage->frametype   = g_CANx_RecBuffer.ECU_RecBuf[g_CANx_RecBuffer.ECU_RecBuff_RPointer].frametype;
-            g_CANx_RecBuffer.ECU_RecBuf[g_CANx_RecBuffer.ECU_RecBuff_RPointer].frametype   = (MSCAN_FrameAndIDTypeDef)0;
-            
-            CAN_RMessage->frame_id    = g_CANx_RecBuffer.ECU_RecBuf[g_CANx_RecBuffer.ECU_RecBuff_RPointer].frame_id;
-            g_CANx_RecBuffer.ECU_RecBuf[g_CANx_RecBuffer.ECU_RecBuff_RPointer].frame_id    = 0;
-            
-            if ((CAN_RMessage->frametype == DataFrameWithStandardId)
-             || (CAN_RMessage->frametype == DataFrameWithExtendedId)) 
-            {
-                CAN_RMessage->data_length  = g_CANx_RecBuffer.ECU_RecBuf[g_CANx_RecBuffer.ECU_RecBuff_RPointer].data_length;
-                g_CANx_RecBuffer.ECU_RecBuf[g_CANx_RecBuffer.ECU_RecBuff_RPointer].data_length = 0;
-                
-                for (i = 0; i < CAN_RMessage->data_length; i++) 
-                {
-                    CAN_RMessage->data[i]  = g_CANx_RecBuffer.ECU_RecBuf[g_CANx_RecBuffer.ECU_RecBuff_RPointer].data[i];  
-                    g_CANx_RecBuffer.ECU_RecBuf[g_CANx_RecBuffer.ECU_RecBuff_RPointer].data[i] = 0;  
-                }       
-            }
-            
-            g_CANx_RecBuffer.ECU_RecBuff_RPointer++;
-          
-            return 0;
-        }  
+    for (i = 0; i < 8; i++) 
+    {
+        frame->data[i] = CAN_Message->data[i];
+    }
+    
+    frame->id  = id;
+    frame->dlc = (uint8_t)CAN_Message->data_length;
+    
+    return 0;
+}
+
+
+
+/**
+ * @brief   Unpack a frame of the soft CAN buffers into a CAN message.
+ * @param   *frame, The packed frame.
+ *          *CAN_Message, The CAN message.
+ * @returns None
+ */
+static void CAN_UnpackFrame(volatile CANFrame_TypeDef* frame, MSCAN_MessageTypeDef* CAN_Message) 
+{
+    uint8_t i;
+    
+    uint32_t id = frame->id;
+    
+    if (CAN_FRAME_IS_EXT(id)) 
+    {
+        CAN_Message->frametype = CAN_FRAME_IS_RTR(id) ? RemoteFrameWithExtendedId : DataFrameWithExtendedId;
     } 
     else 
     {
-        if (g_CANx_RecBuffer.Charger_RecBuff_RPointer >= CHARGER_RECEIVEBUF_SIZE) 
-        {
-            g_CANx_RecBuffer.Charger_RecBuff_RPointer = 0;    
-        }
+        CAN_Message->frametype = CAN_FRAME_IS_RTR(id) ? RemoteFrameWithStandardId : DataFrameWithStandardId;
+    }
     
-        /* If the frame type value of intranet CAN received message is zero,that means the current 
-           received buffer is empty. */
-        if (g_CANx_RecBuffer.Charger_RecBuf[g_CANx_RecBuffer.Charger_RecBuff_RPointer].frametype == (MSCAN_FrameAndIDTypeDef)0)   
-        {        
-            return -1;        
-        } 
-        else /* If the frame type value is not zero,that means there is a valid CAN message in the current received buffer. */
-        {
-            CAN_RMessage->frametype   = g_CANx_RecBuffer.Charger_RecBuf[g_CANx_RecBuffer.Charger_RecBuff_RPointer].frametype;
-            g_CANx_RecBuffer.Charger_RecBuf[g_CANx_RecBuffer.Charger_RecBuff_RPointer].frametype   = (MSCAN_FrameAndIDTypeDef)0;
-            
-            CAN_RMessage->frame_id    = g_CANx_RecBuffer.Charger_RecBuf[g_CANx_RecBuffer.Charger_RecBuff_RPointer].frame_id;
-            g_CANx_RecBuffer.Charger_RecBuf[g_CANx_RecBuffer.Charger_RecBuff_RPointer].frame_id    = 0;
-            
-            if ((CAN_RMessage->frametype == DataFrameWithStandardId)
-             || (CAN_RMessage->frametype == DataFrameWithExtendedId)) 
-            {
-                CAN_RMessage->data_length  = g_CANx_RecBuffer.Charger_RecBuf[g_CANx_RecBuffer.Charger_RecBuff_RPointer].data_length;
-                g_CANx_RecBuffer.Charger_RecBuf[g_CANx_RecBuffer.Charger_RecBuff_RPointer].data_length = 0;
-                
-                for (i = 0; i < CAN_RMessage->data_length; i++) 
-                {
-                    CAN_RMessage->data[i]  = g_CANx_RecBuffer.Charger_RecBuf[g_CANx_RecBuffer.Charger_RecBuff_RPointer].data[i];  
-                    g_CANx_RecBuffer.Charger_RecBuf[g_CANx_RecBuffer.Charger_RecBuff_RPointer].data[i] = 0;  
-                }       
-            }
-            
-            g_CANx_RecBuffer.Charger_RecBuff_RPointer++;
-          
-            return 0;
-        }   
+    CAN_Message->frame_id    = CAN_FrameId(id);
+    CAN_Message->data_length = frame->dlc;
+    
+#ifdef CAN_FRAME_TIMESTAMP
+    CAN_Message->time_stamp  = frame->time;
+#else
+    CAN_Message->time_stamp  = 0;
+#endif
+    
+    for (i = 0; i < 8; i++) 
+    {
+        CAN_Message->data[i] = frame->data[i];
     }
 }
 
 
 
 /**
- * @brief   Fill the specified CAN message to the corresponding CAN send buffers.
+ * @brief   Decode the CAN ID value from the ID field of a packed CAN frame.
+ * @param   fid, The ID field of the packed CAN frame.
+ * @returns The CAN ID value.
+ */
+uint32_t CAN_FrameId(uint32_t fid) 
+{
+#ifdef CAN_FRAME_RAW_ID
+    if (CAN_FRAME_IS_EXT(fid)) 
+    {
+        return ((fid >> 3) & 0x1FFC0000u) | ((fid >> 1) & 0x0003FFFFu);
+    }
+    
+    return fid >> 21;
+#else
+    return fid & CAN_FRAME_ID_MASK;
+#endif
+}
+
+
+
+/**
+ * @brief   Lock the read pointer of a receive buffer against XGATE.
  * @param   CANx, CAN channel number.
- *          *CAN_WMessage, CAN message which will be filled into CAN send buffers.
- * @returns 0: Calling succeeded.Which means the specified CAN message has filled into CAN send buffers.
- * 			-1: Calling failed.Which means CAN send buffers is full and can't fill new messages.
+ * @attention The lock is only needed when XGATE may move the read pointer itself,which is the case 
+ *            for the CAN_DropOldest and CAN_OverwriteLatest policies.XGATE holds the semaphore for 
+ *            a few instructions only,and while CPU core holds it XGATE drops the new frame instead.
+ * @returns 1: The semaphore has been locked.
+ *          0: No lock is needed.
  */
-int16_t Fill_CANSendBuffer(MSCAN_ChannelTypeDef CANx, MSCAN_MessageTypeDef* CAN_WMessage) 
+static uint8_t CAN_ReceiveLock(MSCAN_ChannelTypeDef CANx) 
 {
-    uint8_t i;
+    uint16_t sem_bit;
     
-    if ((CANx < MSCAN_Channel0) || (CANx > MSCAN_Channel4))return -1;
+    if (g_CANx_RecBuffer.stat[CANx].policy == (uint8_t)CAN_DropNewest)return 0;
     
-    if (NULL == CAN_WMessage)return -1;
+    sem_bit = (uint16_t)1u << CAN_RECEIVE_SEMAPHORE(CANx);
     
-    /* If select CAN0,it means that fill the specified CAN message into intranet CAN send buffers */
-    if (MSCAN_Channel0 == CANx) 
+    /* Try to set the semaphore until it is owned by CPU core. */
+    do 
     {
-        /* If the write pointer of intranet CAN send buffers reach to maximum value,clear it. */
-        if (g_CANx_SendBuffer.Intranet_SendBuff_WPointer >= INTRANET_SENDBUF_SIZE) 
-        {
-            g_CANx_SendBuffer.Intranet_SendBuff_WPointer = 0;
-        }
+        XGSEM = (sem_bit << 8) | sem_bit;
+    }while ((XGSEM & sem_bit) == 0);
+    
+    return 1;
+}
+
+
+
+/**
+ * @brief   Unlock the read pointer of a receive buffer.
+ * @param   CANx, CAN channel number.
+ *          locked, Return value of CAN_ReceiveLock().
+ * @returns None
+ */
+static void CAN_ReceiveUnlock(MSCAN_ChannelTypeDef CANx, uint8_t locked) 
+{
+    if (locked != 0)XGSEM = (uint16_t)((uint16_t)1u << CAN_RECEIVE_SEMAPHORE(CANx)) << 8;
+}
+
+
+
+/**
+ * @brief   Build the lookup tables of the software acceptance filter from an accept list.
+ * @param   *list, The accept list,CAN_AcceptList.
+ *          num, Number of entries of the list.
+ * @attention A channel whose extended IDs do not fit into its hash table falls back to 
+ *            CAN_SoftFilterOff,so a wanted frame is never dropped because of the table size.
+ * @returns None
+ */
+static void CAN_SoftFilter_Init(const CANAcceptId_TypeDef* list, uint16_t num) 
+{
+    uint8_t ch,idx,len;
+    uint16_t i;
+    uint32_t key;
+    
+    for (ch = 0; ch < CAN_CHANNEL_NUM; ch++) 
+    {
+        for (i = 0; i < 256; i++)g_CAN_SoftFilter.std_map[ch][i] = 0;
+        
+        for (i = 0; i < CAN_SOFTFILTER_HASH_SIZE; i++)g_CAN_SoftFilter.ext_hash[ch][i] = 0;
+        
+        g_CAN_SoftFilter.mode[ch]  = (uint8_t)CAN_ChannelConfig[ch].soft_filter;
+        g_CAN_SoftFilter.probe[ch] = 0;
+    }
+    
+    for (i = 0; i < num; i++) 
+    {
+        ch  = (uint8_t)list[i].ch;
+        key = list[i].id;
         
-        /* Get the frame type value and judge it.If the value is not zero,that means the 
-           pointed buffer is full,and user can not fill the CAN message to it. */    
-        if (g_CANx_SendBuffer.Intranet_SendBuff[g_CANx_SendBuffer.Intranet_SendBuff_WPointer].frametype != (MSCAN_FrameAndIDTypeDef)0) 
+        if (list[i].id_format == OnlyAcceptStandardID) 
         {
-            return -1;    
-        } 
-        else /* If the frame type value is zero,that means the pointed buffer is empty,and user can fill the CAN message to it. */
-        {   
-            g_CANx_SendBuffer.Intranet_SendBuff[g_CANx_SendBuffer.Intranet_SendBuff_WPointer].frame_id  = CAN_WMessage->frame_id;
-
-            if ((CAN_WMessage->frametype == DataFrameWithStandardId)
-             || (CAN_WMessage->frametype == DataFrameWithExtendedId)) 
-            {
-                g_CANx_SendBuffer.Intranet_SendBuff[g_CANx_SendBuffer.Intranet_SendBuff_WPointer].data_length = CAN_WMessage->data_length;
-                               
-                for (i = 0; i < CAN_WMessage->data_length; i++) 
-                {
-                    g_CANx_SendBuffer.Intranet_SendBuff[g_CANx_SendBuffer.Intranet_SendBuff_WPointer].data[i] = CAN_WMessage->data[i];
-                }
-            }
+            key &= 0x7FFu;
             
-            g_CANx_SendBuffer.Intranet_SendBuff[g_CANx_SendBuffer.Intranet_SendBuff_WPointer].frametype = CAN_WMessage->frametype;
+            g_CAN_SoftFilter.std_map[ch][(uint8_t)(key >> 3)] |= (uint8_t)(1u << (key & 7u));
             
-            g_CANx_SendBuffer.Intranet_SendBuff_WPointer++;
-
-            return 0; 
+            continue;
         }
-    }  
-    else if (MSCAN_Channel1 == CANx) /* If select CAN1,it means that fill the specified CAN message into ECU CAN send buffers. */ 
-    {
-        /* If the write pointer of ECU CAN send buffers reach to maximum value,clear it. */
-        if (g_CANx_SendBuffer.ECU_SendBuff_WPointer >= ECU_SENDBUF_SIZE) 
+        
+        key &= CAN_FRAME_ID_MASK;
+        
+        if (g_CAN_SoftFilter.mode[ch] == (uint8_t)CAN_SoftFilterJ1939)key = CAN_J1939_PGN(key);
+        
+        idx = CAN_SOFTFILTER_HASH(key);
+        key |= CAN_SOFTFILTER_VALID;
+        
+        /* Linear probing,the same key is stored once. */
+        for (len = 0; len < CAN_SOFTFILTER_HASH_SIZE; len++) 
         {
-            g_CANx_SendBuffer.ECU_SendBuff_WPointer = 0;
+            if ((g_CAN_SoftFilter.ext_hash[ch][idx] == 0) || (g_CAN_SoftFilter.ext_hash[ch][idx] == key))break;
+            
+            idx = (idx + 1) & (CAN_SOFTFILTER_HASH_SIZE - 1);
         }
         
-        /* Get the frame type value and judge it.If the value is not zero,that means the 
-           pointed buffer is full,and user can not fill the CAN message to it. */     
-        if (g_CANx_SendBuffer.ECU_SendBuff[g_CANx_SendBuffer.ECU_SendBuff_WPointer].frametype != (MSCAN_FrameAndIDTypeDef)0) 
+        if (len == CAN_SOFTFILTER_HASH_SIZE) 
         {
-            return -1;    
-        } 
-        else  /* If the frame type value is zero,that means the pointed buffer is empty,and user can fill the CAN message to it. */
-        {   
-            g_CANx_SendBuffer.ECU_SendBuff[g_CANx_SendBuffer.ECU_SendBuff_WPointer].frame_id  = CAN_WMessage->frame_id;
-
-            if ((CAN_WMessage->frametype == DataFrameWithStandardId)
-             || (CAN_WMessage->frametype == DataFrameWithExtendedId)) 
-            {
-                g_CANx_SendBuffer.ECU_SendBuff[g_CANx_SendBuffer.ECU_SendBuff_WPointer].data_length = CAN_WMessage->data_length;
-                               
-                for (i = 0; i < CAN_WMessage->data_length; i++) 
-                {
-                    g_CANx_SendBuffer.ECU_SendBuff[g_CANx_SendBuffer.ECU_SendBuff_WPointer].data[i] = CAN_WMessage->data[i];
-                }
-            }
-            
-            g_CANx_SendBuffer.ECU_SendBuff[g_CANx_SendBuffer.ECU_SendBuff_WPointer].frametype = CAN_WMessage->frametype;
+            g_CAN_SoftFilter.mode[ch] = (uint8_t)CAN_SoftFilterOff;
             
-            g_CANx_SendBuffer.ECU_SendBuff_WPointer++;
+            continue;
+        }
+        
+        g_CAN_SoftFilter.ext_hash[ch][idx] = key;
+        
+        if (len > g_CAN_SoftFilter.probe[ch])g_CAN_SoftFilter.probe[ch] = len;
+    }
+}
 
-            return 0; 
-        }    
-    } 
-    else /* If select CAN4,it means that fill the specified CAN message into charger CAN send buffers. */ 
+
+
+/**
+ * @brief   Build the mailbox keys from the mailbox list and empty all mailboxes.
+ * @param   None
+ * @attention The mailboxes of one channel are placed one after another,so XGATE only compares
+ *            the keys of the channel which received the frame.
+ * @returns None
+ */
+static void CAN_Mailbox_Init(void) 
+{
+    uint8_t ch,i,n = 0;
+    
+    for (ch = 0; ch < CAN_CHANNEL_NUM; ch++) 
     {
-        if (g_CANx_SendBuffer.Charger_SendBuff_WPointer >= CHARGER_SENDBUF_SIZE) 
+        g_CAN_Mailbox.first[ch] = n;
+        
+        for (i = 0; i < sizeof(CAN_MailboxList) / sizeof(CAN_MailboxList[0]); i++) 
         {
-            g_CANx_SendBuffer.Charger_SendBuff_WPointer = 0;
-        }
+            if ((uint8_t)CAN_MailboxList[i].ch != ch)continue;
             
-        if (g_CANx_SendBuffer.Charger_SendBuff[g_CANx_SendBuffer.Charger_SendBuff_WPointer].frametype != (MSCAN_FrameAndIDTypeDef)0) 
-        {
-            return -1;    
-        } 
-        else 
-        {   
-            g_CANx_SendBuffer.Charger_SendBuff[g_CANx_SendBuffer.Charger_SendBuff_WPointer].frame_id  = CAN_WMessage->frame_id;
-
-            if ((CAN_WMessage->frametype == DataFrameWithStandardId)
-             || (CAN_WMessage->frametype == DataFrameWithExtendedId)) 
+            if (CAN_MailboxList[i].id_format == OnlyAcceptStandardID) 
             {
-                g_CANx_SendBuffer.Charger_SendBuff[g_CANx_SendBuffer.Charger_SendBuff_WPointer].data_length = CAN_WMessage->data_length;
-                               
-                for (i = 0; i < CAN_WMessage->data_length; i++) 
-                {
-                    g_CANx_SendBuffer.Charger_SendBuff[g_CANx_SendBuffer.Charger_SendBuff_WPointer].data[i] = CAN_WMessage->data[i];
-                }
+                g_CAN_Mailbox.key[n] = CAN_FRAME_STD(CAN_MailboxList[i].id & 0x7FFu, 0);
+            } 
+            else 
+            {
+                g_CAN_Mailbox.key[n] = CAN_FRAME_EXT(CAN_MailboxList[i].id & CAN_FRAME_ID_MASK, 0);
             }
             
-            g_CANx_SendBuffer.Charger_SendBuff[g_CANx_SendBuffer.Charger_SendBuff_WPointer].frametype = CAN_WMessage->frametype;
-            
-            g_CANx_SendBuffer.Charger_SendBuff_WPointer++;
+            g_CAN_Mailbox.box[n].seq = 0;
+            n++;
+        }
+        
+        g_CAN_Mailbox.num[ch] = n - g_CAN_Mailbox.first[ch];
+    }
+}
+
+
 
-            return 0; 
-        }    
+/**
+ * @brief   Get the greatest common divisor of two periods.
+ * @param   a, b, The periods,not zero.
+ * @returns The greatest common divisor.
+ */
+static uint16_t CAN_CyclicGcd(uint16_t a, uint16_t b) 
+{
+    uint16_t t;
+    
+    while (b != 0) 
+    {
+        t = a % b;
+        a = b;
+        b = t;
     }
+    
+    return a;
 }
 
 
 
 /**
- * @brief   Check the CAN send buffers and judge if there is a valid CAN messages.If yes,get them out.
- * @param   CANx, CAN channel number.
- *          *CAN_RMessage, buffer which will store the read CAN message. 
- * @returns  0: Calling succeeded.Which means the pointed send buffer has a valid CAN message and user
- *              have got it.
- * 			-1: Calling failed.Which means the pointed send buffer does not have a valid CAN message.
+ * @brief   Place the cyclic messages on their first send ticks and record the channels they are sent on.
+ * @param   None
+ * @attention Two messages with the periods p1,p2 and the offsets o1,o2 are sent in the same tick 
+ *            at some time if and only if o1 and o2 are equal modulo gcd(p1, p2).An automatic 
+ *            offset is the smallest one which collides with the fewest messages placed before.
+ * @returns None
  */
-int16_t Check_CANSendBuffer(MSCAN_ChannelTypeDef CANx, MSCAN_MessageTypeDef* CAN_RMessage) 
+static void CAN_Cyclic_Init(void) 
 {
-    uint8_t i;
+    uint8_t i,j,hits,best_hits;
     
-    if ((CANx < MSCAN_Channel0) || (CANx > MSCAN_Channel4))return -1;
+    uint16_t period,offset,best,g;
     
-    if (NULL == CAN_RMessage)return -1;
+    CAN_CyclicChannels = 0;
     
-    /* If select CAN0, that means check the intranet CAN send buffers and read the CAN messages. */
-    if (MSCAN_Channel0 == CANx) 
+    for (i = 0; i < sizeof(CAN_CyclicTable) / sizeof(CAN_CyclicTable[0]); i++) 
     {
-        /* If the read pointer of intranet CAN send buffers reach to maximum value,clear it. */
-        if (g_CANx_SendBuffer.Intranet_SendBuff_RPointer >= INTRANET_SENDBUF_SIZE) 
+        period = CAN_CyclicTable[i].period;
+        
+        /* The schedule fills the send buffer without the checks of Fill_CANSendBuffer(). */
+        if ((period == 0) || (CAN_CyclicTable[i].ch > MSCAN_Channel4)) 
         {
-            g_CANx_SendBuffer.Intranet_SendBuff_RPointer = 0;
+            CAN_CyclicCount[i] = 0;
+            continue;
         }
         
-        /* Get the frame type value and judge it.If the value is not zero,that means the 
-           read pointed buffer is full,and user can read the CAN messages from it. */ 
-        if (g_CANx_SendBuffer.Intranet_SendBuff[g_CANx_SendBuffer.Intranet_SendBuff_RPointer].frametype != (MSCAN_FrameAndIDTypeDef)0) 
+        CAN_CyclicChannels |= (uint8_t)(1u << CAN_CyclicTable[i].ch);
+        
+        if (CAN_CyclicTable[i].offset != CAN_CYCLIC_AUTO_OFFSET) 
         {
-            CAN_RMessage->frametype = g_CANx_SendBuffer.Intranet_SendBuff[g_CANx_SendBuffer.Intranet_SendBuff_RPointer].frametype;
-            g_CANx_SendBuffer.Intranet_SendBuff[g_CANx_SendBuffer.Intranet_SendBuff_RPointer].frametype = (MSCAN_FrameAndIDTypeDef)0;
-            
-            CAN_RMessage->frame_id  = g_CANx_SendBuffer.Intranet_SendBuff[g_CANx_SendBuffer.Intranet_SendBuff_RPointer].frame_id;
-            g_CANx_SendBuffer.Intranet_SendBuff[g_CANx_SendBuffer.Intranet_SendBuff_RPointer].frame_id = 0;
-            
-            if ((CAN_RMessage->frametype == DataFrameWithStandardId)
-             || (CAN_RMessage->frametype == DataFrameWithExtendedId)) 
-            {
-                CAN_RMessage->data_length = g_CANx_SendBuffer.Intranet_SendBuff[g_CANx_SendBuffer.Intranet_SendBuff_RPointer].data_length;
-                g_CANx_SendBuffer.Intranet_SendBuff[g_CANx_SendBuffer.Intranet_SendBuff_RPointer].data_length = 0;
-                
-                for (i = 0; i < CAN_RMessage->data_length; i++) 
-                {
-                    CAN_RMessage->data[i] = g_CANx_SendBuffer.Intranet_SendBuff[g_CANx_SendBuffer.Intranet_SendBuff_RPointer].data[i];
-                    g_CANx_SendBuffer.Intranet_SendBuff[g_CANx_SendBuffer.Intranet_SendBuff_RPointer].data[i] = 0;    
-                }
-            }
-            
-            g_CANx_SendBuffer.Intranet_SendBuff_RPointer++;
-            
-            return 0;
+            best = CAN_CyclicTable[i].offset % period;
         } 
-        else /* If the value is zero,that means the pointed buffer is empty,user can not read the CAN messages from it. */
-        {
-            return -1;
-        }
-    } 
-    else if (MSCAN_Channel1 == CANx) 
-    {
-        if (g_CANx_SendBuffer.ECU_SendBuff_RPointer >= ECU_SENDBUF_SIZE) 
-        {
-            g_CANx_SendBuffer.ECU_SendBuff_RPointer = 0;
-        }
-        
-        if (g_CANx_SendBuffer.ECU_SendBuff[g_CANx_SendBuffer.ECU_SendBuff_RPointer].frametype != (MSCAN_FrameAndIDTypeDef)0) 
+        else 
         {
-            CAN_RMessage->frametype = g_CANx_SendBuffer.ECU_SendBuff[g_CANx_SendBuffer.ECU_SendBuff_RPointer].frametype;
-            g_CANx_SendBuffer.ECU_SendBuff[g_CANx_SendBuffer.ECU_SendBuff_RPointer].frametype = (MSCAN_FrameAndIDTypeDef)0;
-            
-            CAN_RMessage->frame_id  = g_CANx_SendBuffer.ECU_SendBuff[g_CANx_SendBuffer.ECU_SendBuff_RPointer].frame_id;
-            g_CANx_SendBuffer.ECU_SendBuff[g_CANx_SendBuffer.ECU_SendBuff_RPointer].frame_id = 0;
+            best      = 0;
+            best_hits = 0xFF;
             
-            if ((CAN_RMessage->frametype == DataFrameWithStandardId)
-             || (CAN_RMessage->frametype == DataFrameWithExtendedId)) 
+            for (offset = 0; (offset < period) && (best_hits != 0); offset++) 
             {
-                CAN_RMessage->data_length = g_CANx_SendBuffer.ECU_SendBuff[g_CANx_SendBuffer.ECU_SendBuff_RPointer].data_length;
-                g_CANx_SendBuffer.ECU_SendBuff[g_CANx_SendBuffer.ECU_SendBuff_RPointer].data_length = 0;
+                hits = 0;
                 
-                for (i = 0; i < CAN_RMessage->data_length; i++) 
+                /* The messages placed before keep their offset plus one in the counters. */
+                for (j = 0; j < i; j++) 
                 {
-                    CAN_RMessage->data[i] = g_CANx_SendBuffer.ECU_SendBuff[g_CANx_SendBuffer.ECU_SendBuff_RPointer].data[i];
-                    g_CANx_SendBuffer.ECU_SendBuff[g_CANx_SendBuffer.ECU_SendBuff_RPointer].data[i] = 0;    
+                    if (CAN_CyclicCount[j] == 0)continue;
+                    
+                    g = CAN_CyclicGcd(period, CAN_CyclicTable[j].period);
+                    
+                    if ((offset % g) == ((CAN_CyclicCount[j] - 1) % g))hits++;
                 }
-            }
-            
-            g_CANx_SendBuffer.ECU_SendBuff_RPointer++;
-            
-            return 0;
-        } 
-        else 
-        {
-            return -1;
-        }    
-    } 
-    else 
-    {
-        if (g_CANx_SendBuffer.Charger_SendBuff_RPointer >= CHARGER_SENDBUF_SIZE) 
-        {
-            g_CANx_SendBuffer.Charger_SendBuff_RPointer = 0;
-        }
-        
-        if (g_CANx_SendBuffer.Charger_SendBuff[g_CANx_SendBuffer.Charger_SendBuff_RPointer].frametype != (MSCAN_FrameAndIDTypeDef)0) 
-        {
-            CAN_RMessage->frametype = g_CANx_SendBuffer.Charger_SendBuff[g_CANx_SendBuffer.Charger_SendBuff_RPointer].frametype;
-            g_CANx_SendBuffer.Charger_SendBuff[g_CANx_SendBuffer.Charger_SendBuff_RPointer].frametype = (MSCAN_FrameAndIDTypeDef)0;
-            
-            CAN_RMessage->frame_id  = g_CANx_SendBuffer.Charger_SendBuff[g_CANx_SendBuffer.Charger_SendBuff_RPointer].frame_id;
-            g_CANx_SendBuffer.Charger_SendBuff[g_CANx_SendBuffer.Charger_SendBuff_RPointer].frame_id = 0;
-            
-            if ((CAN_RMessage->frametype == DataFrameWithStandardId)
-             || (CAN_RMessage->frametype == DataFrameWithExtendedId)) 
-            {
-                CAN_RMessage->data_length = g_CANx_SendBuffer.Charger_SendBuff[g_CANx_SendBuffer.Charger_SendBuff_RPointer].data_length;
-                g_CANx_SendBuffer.Charger_SendBuff[g_CANx_SendBuffer.Charger_SendBuff_RPointer].data_length = 0;
                 
-                for (i = 0; i < CAN_RMessage->data_length; i++) 
+                if (hits < best_hits) 
                 {
-                    CAN_RMessage->data[i] = g_CANx_SendBuffer.Charger_SendBuff[g_CANx_SendBuffer.Charger_SendBuff_RPointer].data[i];
-                    g_CANx_SendBuffer.Charger_SendBuff[g_CANx_SendBuffer.Charger_SendBuff_RPointer].data[i] = 0;    
+                    best      = offset;
+                    best_hits = hits;
                 }
             }
-            
-            g_CANx_SendBuffer.Charger_SendBuff_RPointer++;
-            
-            return 0;
-        } 
-        else 
-        {
-            return -1;
-        }     
+        }
+        
+        /* The first RTI tick after the start sends the messages of offset zero. */
+        CAN_CyclicCount[i] = best + 1;
+    }
+}
+
+
+
+/**
+ * @brief   Initialize the buffer descriptors of all channels and empty the soft CAN buffers.
+ * @param   None
+ * @attention This function must be called before the MSCAN receive interrupts are enabled,
+ *            because XGATE locates the receive slots through these descriptors and looks up the
+ *            tables of the software acceptance filter.It must also be called before the RTI is
+ *            started,which runs the cyclic message schedule.
+ * @returns None
+ */
+void CAN_MessageBuffer_Init(void) 
+{
+    uint8_t i,k;
+    uint8_t rec_base = 0,send_base = 0;
+    
+    for (i = 0; i < CAN_CHANNEL_NUM; i++) 
+    {
+        g_CANx_RecBuffer.ch[i].WPointer = 0;
+        g_CANx_RecBuffer.ch[i].RPointer = 0;
+        g_CANx_RecBuffer.ch[i].base     = rec_base;
+        g_CANx_RecBuffer.ch[i].mask     = CAN_ChannelConfig[i].receive_size - 1;
+        
+        g_CANx_RecBuffer.stat[i].drop_count   = 0;
+        g_CANx_RecBuffer.stat[i].reject_count = 0;
+        g_CANx_RecBuffer.stat[i].high_water   = 0;
+        g_CANx_RecBuffer.stat[i].policy       = (uint8_t)CAN_ChannelConfig[i].policy;
+        g_CANx_RecBuffer.stat[i].entry_count  = 0;
+        g_CANx_RecBuffer.stat[i].frame_count  = 0;
+        g_CANx_RecBuffer.stat[i].burst_max    = 0;
+        
+        g_CANx_SendBuffer.ch[i].WPointer = 0;
+        g_CANx_SendBuffer.ch[i].RPointer = 0;
+        g_CANx_SendBuffer.ch[i].base     = send_base;
+        g_CANx_SendBuffer.ch[i].mask     = CAN_ChannelConfig[i].send_size - 1;
+        
+        g_CANx_SendBuffer.stat[i].seq   = 0;
+        g_CANx_SendBuffer.stat[i].min   = 0;
+        g_CANx_SendBuffer.stat[i].max   = 0;
+        g_CANx_SendBuffer.stat[i].count = 0;
+        g_CANx_SendBuffer.stat[i].sum   = 0;
+        
+        for (k = 0; k < CAN_TXLATENCY_BINS; k++)g_CANx_SendBuffer.stat[i].hist[k] = 0;
+        
+        g_CANx_RecBuffer.event[i] = 0;
+        
+        CAN_ReceiveTask[i] = -1;
+        
+        rec_base  += CAN_ChannelConfig[i].receive_size;
+        send_base += CAN_ChannelConfig[i].send_size;
+    }
+    
+    CAN_SoftFilter_Init(CAN_AcceptList, sizeof(CAN_AcceptList) / sizeof(CAN_AcceptList[0]));
+    
+    CAN_Mailbox_Init();
+    
+    CAN_Cyclic_Init();
+}
+
+
+
+/**
+ * @brief   Check the CAN received buffers and judge if there is a valid CAN messages.If yes,get them out.
+ * @param   CANx, CAN channel number.
+ *          *CAN_RMessage, Store the read CAN message data buffer.
+ * @attention The receive buffers are single producer/single consumer rings.XGATE is the only writer of
+ *            the write pointer and CPU core is the only writer of the read pointer,so the slot is copied
+ *            out first and the read pointer is published afterwards.
+ * @returns 0: There is a valid CAN message and get it out from CAN receive buffer.Calling succeeded.
+ * 			-1: There is not a valid CAN message.Calling failed.
+ */
+int16_t Check_CANReceiveBuffer(MSCAN_ChannelTypeDef CANx, MSCAN_MessageTypeDef* CAN_RMessage) 
+{
+    CANFrame_TypeDef frame;
+    
+    if (NULL == CAN_RMessage)return -1;
+    
+    if (Check_CANReceiveFrame(CANx, &frame) != 0)return -1;
+    
+    CAN_UnpackFrame(&frame, CAN_RMessage);
+    
+    return 0;
+}
+
+
+
+/**
+ * @brief   Get one packed CAN frame out of the specified CAN receive buffer without decoding it.
+ * @param   CANx, CAN channel number.
+ *          *CAN_RFrame, Store the read CAN frame.
+ * @attention The ID field can be compared against constants built by CAN_FRAME_STD() and 
+ *            CAN_FRAME_EXT(),and CAN_FrameId() decodes the CAN ID value only when it is needed.
+ * @returns 0: There is a valid CAN frame and get it out from CAN receive buffer.Calling succeeded.
+ * 			-1: There is not a valid CAN frame.Calling failed.
+ */
+int16_t Check_CANReceiveFrame(MSCAN_ChannelTypeDef CANx, CANFrame_TypeDef* CAN_RFrame) 
+{
+    uint8_t rp,locked;
+    
+    int16_t ret_val = -1;
+    
+    if ((CANx < MSCAN_Channel0) || (CANx > MSCAN_Channel4))return -1;
+    
+    if (NULL == CAN_RFrame)return -1;
+    
+    locked = CAN_ReceiveLock(CANx);
+    
+    rp = g_CANx_RecBuffer.ch[CANx].RPointer;
+    
+    /* If the read pointer catches up with the write pointer,the receive buffer is empty. */
+    if (rp != g_CANx_RecBuffer.ch[CANx].WPointer) 
+    {
+        *CAN_RFrame = g_CANx_RecBuffer.RecBuf[g_CANx_RecBuffer.ch[CANx].base + (rp & g_CANx_RecBuffer.ch[CANx].mask)];
+        
+        /* Release the slot to XGATE only after the frame has been copied out. */
+        g_CANx_RecBuffer.ch[CANx].RPointer = rp + 1;
+        
+        ret_val = 0;
+    }
+    
+    CAN_ReceiveUnlock(CANx, locked);
+    
+    return ret_val;
+}
+
+
+
+/**
+ * @brief   Get up to max_num CAN messages out of a receive buffer whose read pointer XGATE may move.
+ * @param   CANx, CAN channel number.
+ *          *CAN_RMessage, Array which stores the read CAN messages,it must hold max_num messages at least.
+ *          max_num, Maximum number of CAN messages to be read.
+ * @attention XGATE can not apply the overflow policy while CPU core holds the receive semaphore,
+ *            so the semaphore is only held to copy CAN_RECEIVE_BATCH_CHUNK packed frames and to
+ *            publish the read pointer.The frames are unpacked after the semaphore is released,
+ *            and the pointers are read again for every chunk because XGATE may have dropped 
+ *            unread frames in between.
+ * @returns The number of CAN messages which have been read.
+ */
+static int16_t CAN_ReceiveBatchLocked(MSCAN_ChannelTypeDef CANx, MSCAN_MessageTypeDef* CAN_RMessage, uint8_t max_num) 
+{
+    uint8_t rp,wp,n,k,i,locked;
+    uint8_t count = 0;
+    
+    CANFrame_TypeDef chunk[CAN_RECEIVE_BATCH_CHUNK];
+    
+    while (count < max_num) 
+    {
+        n = max_num - count;
+        
+        if (n > CAN_RECEIVE_BATCH_CHUNK)n = CAN_RECEIVE_BATCH_CHUNK;
+        
+        locked = CAN_ReceiveLock(CANx);
+        
+        rp = g_CANx_RecBuffer.ch[CANx].RPointer;
+        wp = g_CANx_RecBuffer.ch[CANx].WPointer;
+        
+        for (k = 0; (k < n) && (rp != wp); k++, rp++) 
+        {
+            chunk[k] = g_CANx_RecBuffer.RecBuf[g_CANx_RecBuffer.ch[CANx].base + (rp & g_CANx_RecBuffer.ch[CANx].mask)];
+        }
+        
+        g_CANx_RecBuffer.ch[CANx].RPointer = rp;
+        
+        CAN_ReceiveUnlock(CANx, locked);
+        
+        for (i = 0; i < k; i++)CAN_UnpackFrame(&chunk[i], CAN_RMessage++);
+        
+        count += k;
+        
+        /* The receive buffer is empty. */
+        if (k < n)break;
+    }
+    
+    return (int16_t)count;
+}
+
+
+
+/**
+ * @brief   Get up to max_num CAN messages out of the specified CAN receive buffer in one call.
+ * @param   CANx, CAN channel number.
+ *          *CAN_RMessage, Array which stores the read CAN messages,it must hold max_num messages at least.
+ *          max_num, Maximum number of CAN messages to be read.
+ * @attention The pending frames are copied out as at most two contiguous runs of slots,one up to the
+ *            end of the ring and one from the start of the ring.The read pointer is published once
+ *            after all frames have been copied,so XGATE gets the whole run of slots back at one time.
+ *            A channel whose overflow policy lets XGATE move the read pointer is read in short
+ *            locked chunks instead,see CAN_ReceiveBatchLocked().
+ * @returns >=0: The number of CAN messages which have been read.Zero means the receive buffer is empty.
+ * 			-1: Calling failed.
+ */
+int16_t Check_CANReceiveBuffer_Batch(MSCAN_ChannelTypeDef CANx, MSCAN_MessageTypeDef* CAN_RMessage, uint8_t max_num) 
+{
+    uint8_t rp,wp,idx,slot,run;
+    uint8_t count = 0;
+    
+    if ((CANx < MSCAN_Channel0) || (CANx > MSCAN_Channel4))return -1;
+    
+    if (NULL == CAN_RMessage)return -1;
+    
+    if (g_CANx_RecBuffer.stat[CANx].policy != (uint8_t)CAN_DropNewest)return CAN_ReceiveBatchLocked(CANx, CAN_RMessage, max_num);
+    
+    rp = g_CANx_RecBuffer.ch[CANx].RPointer;
+    wp = g_CANx_RecBuffer.ch[CANx].WPointer;
+    
+    while ((rp != wp) && (count < max_num)) 
+    {
+        /* Length of the contiguous run,which ends at the write pointer or at the end of the ring. */
+        idx = rp & g_CANx_RecBuffer.ch[CANx].mask;
+        run = wp - rp;
+        
+        if (run > (uint8_t)(g_CANx_RecBuffer.ch[CANx].mask + 1 - idx))run = g_CANx_RecBuffer.ch[CANx].mask + 1 - idx;
+        
+        if (run > (uint8_t)(max_num - count))run = max_num - count;
+        
+        slot   = g_CANx_RecBuffer.ch[CANx].base + idx;
+        rp    += run;
+        count += run;
+        
+        /* 
+        The frame pool is in paged RAM and only reachable by global addressing,so the block 
+        is copied slot by slot instead of calling the near memcpy.
+        */
+        for (; run != 0; run--) 
+        {
+            CAN_UnpackFrame(&g_CANx_RecBuffer.RecBuf[slot++], CAN_RMessage++);
+        }
+    }
+    
+    /* Release all the copied slots to XGATE at once. */
+    g_CANx_RecBuffer.ch[CANx].RPointer = rp;
+    
+    return (int16_t)count;
+}
+
+
+
+/**
+ * @brief   Read the latest CAN message of a mailbox.
+ * @param   CANx, CAN channel number.
+ *          id_format, ID format of the mailbox.
+ *          id, CAN ID of the mailbox.
+ *          *CAN_RMessage, Store the read CAN message.
+ *          *seq, Store the sequence counter of the read message,it may be NULL.A caller which keeps
+ *                the last counter sees a new message when the counter has changed.
+ * @attention XGATE may overwrite the mailbox at any time.The copy is taken again until the sequence
+ *            counter is even and has not changed during the copy,so the message is never torn.
+ * @returns 0: Calling succeeded.
+ * 			-1: Calling failed.There is no such mailbox or no message has been received yet.
+ */
+int16_t CAN_ReadMailbox(MSCAN_ChannelTypeDef CANx, AcceptIDFormat id_format, uint32_t id, MSCAN_MessageTypeDef* CAN_RMessage, uint16_t* seq) 
+{
+    uint8_t i,end;
+    uint16_t seq1,seq2;
+    uint32_t key;
+    
+    CANFrame_TypeDef frame;
+    
+    if ((CANx < MSCAN_Channel0) || (CANx > MSCAN_Channel4))return -1;
+    
+    if (NULL == CAN_RMessage)return -1;
+    
+    key = (id_format == OnlyAcceptStandardID) ? CAN_FRAME_STD(id & 0x7FFu, 0) : CAN_FRAME_EXT(id & CAN_FRAME_ID_MASK, 0);
+    
+    i   = g_CAN_Mailbox.first[CANx];
+    end = i + g_CAN_Mailbox.num[CANx];
+    
+    while ((i < end) && (g_CAN_Mailbox.key[i] != key))i++;
+    
+    if (i == end)return -1;
+    
+    do 
+    {
+        seq1  = g_CAN_Mailbox.box[i].seq;
+        frame = g_CAN_Mailbox.box[i].frame;
+        seq2  = g_CAN_Mailbox.box[i].seq;
+    }while ((seq1 != seq2) || ((seq1 & 1u) != 0));
+    
+    if (seq1 == 0)return -1;
+    
+    CAN_UnpackFrame(&frame, CAN_RMessage);
+    
+    if (seq != NULL)*seq = seq1;
+    
+    return 0;
+}
+
+
+
+/**
+ * @brief   Get the receive statistic of the specified channel.
+ * @param   CANx, CAN channel number.
+ *          *stat, Store the receive statistic.
+ * @attention The drop counter and the high water mark are the data to size the receive buffers,
+ *            the reject counter shows the load which the hardware filters let through in vain.
+ *            The handler entries per frame,entry_count / frame_count,show how well a burst is
+ *            taken in one interrupt entry.
+ * @returns 0: Calling succeeded.
+ * 			-1: Calling failed.
+ */
+int16_t CAN_GetReceiveStatistic(MSCAN_ChannelTypeDef CANx, CANReceiveStatistic_TypeDef* stat) 
+{
+    if ((CANx < MSCAN_Channel0) || (CANx > MSCAN_Channel4))return -1;
+    
+    if (NULL == stat)return -1;
+    
+    *stat = g_CANx_RecBuffer.stat[CANx];
+    
+    return 0;
+}
+
+
+
+/**
+ * @brief   Put a CAN message into the send buffer of a channel.
+ * @param   CANx, CAN channel number.
+ *          *CAN_WMessage, CAN message which will be filled into CAN send buffers.
+ * @attention The whole frame is written into the free slot before the write pointer is published,
+ *            so the consumer never sees a half written frame.Then XGATE software trigger 1 is set,
+ *            and XGATE loads the frame into the hardware transmit buffers.
+ * @returns 0: Calling succeeded.
+ * 			-1: Calling failed.The send buffer is full or the CAN message is invalid.
+ */
+static int16_t CAN_SendBufferPut(MSCAN_ChannelTypeDef CANx, MSCAN_MessageTypeDef* CAN_WMessage) 
+{
+    uint8_t wp;
+    
+    volatile CANFrame_TypeDef* slot;
+    
+    wp = g_CANx_SendBuffer.ch[CANx].WPointer;
+    
+    /* If the write pointer is one depth ahead of the read pointer,the send buffer is full. */
+    if ((uint8_t)(wp - g_CANx_SendBuffer.ch[CANx].RPointer) > g_CANx_SendBuffer.ch[CANx].mask)return -1;
+    
+    slot = &g_CANx_SendBuffer.SendBuff[g_CANx_SendBuffer.ch[CANx].base + (wp & g_CANx_SendBuffer.ch[CANx].mask)];
+    
+    if (CAN_PackFrame(CAN_WMessage, slot) != 0)return -1;
+    
+#ifdef CAN_FRAME_TIMESTAMP
+    /* XGATE measures the queue latency from this time stamp. */
+    slot->time = SystemTime_Us();
+#endif
+    
+    /* Publish the frame to the consumer. */
+    g_CANx_SendBuffer.ch[CANx].WPointer = wp + 1;
+    
+    /* Set XGATE software trigger 1 to start the transmit routine in XGATE. */
+    XGSWT = 0x0202;
+    
+    return 0;
+}
+
+
+
+/**
+ * @brief   Fill the specified CAN message to the corresponding CAN send buffers.
+ * @param   CANx, CAN channel number.
+ *          *CAN_WMessage, CAN message which will be filled into CAN send buffers.
+ * @attention Each send buffer has a single producer.The send buffers of the channels in the cyclic
+ *            schedule are filled by CAN_CyclicSchedule() in RTI_ISR only,so they are refused here.
+ * @returns 0: Calling succeeded.Which means the specified CAN message has filled into CAN send buffers.
+ * 			-1: Calling failed.Which means CAN send buffers is full and can't fill new messages,
+ *              the CAN message is invalid,or the channel belongs to the cyclic schedule.
+ */
+int16_t Fill_CANSendBuffer(MSCAN_ChannelTypeDef CANx, MSCAN_MessageTypeDef* CAN_WMessage) 
+{
+    if ((CANx < MSCAN_Channel0) || (CANx > MSCAN_Channel4))return -1;
+    
+    if (NULL == CAN_WMessage)return -1;
+    
+    if ((CAN_CyclicChannels & (1u << CANx)) != 0)return -1;
+    
+    return CAN_SendBufferPut(CANx, CAN_WMessage);
+}
+
+
+
+/**
+ * @brief   Send the cyclic messages which are due in this RTI tick.
+ * @param   None
+ * @attention This function must be called by RTI_ISR once per tick.It is the only producer of the
+ *            send buffers of the channels in the schedule table,Fill_CANSendBuffer() refuses these 
+ *            channels.A message is skipped in this period if its send buffer is full.
+ * @returns None
+ */
+void CAN_CyclicSchedule(void) 
+{
+    uint8_t i,k;
+    
+    MSCAN_MessageTypeDef CAN_WMessage;
+    
+    const CANCyclicMessage_TypeDef* entry;
+    
+    for (i = 0; i < sizeof(CAN_CyclicTable) / sizeof(CAN_CyclicTable[0]); i++) 
+    {
+        if (CAN_CyclicCount[i] == 0)continue;
+        
+        if (--CAN_CyclicCount[i] != 0)continue;
+        
+        entry = &CAN_CyclicTable[i];
+        
+        CAN_CyclicCount[i] = entry->period;
+        
+        CAN_WMessage.frametype   = entry->frametype;
+        CAN_WMessage.frame_id    = entry->id;
+        CAN_WMessage.data_length = entry->data_length;
+        
+        /* The whole data field is packed,so the bytes behind the data length are sent as zeros. */
+        for (k = 0; k < 8; k++)CAN_WMessage.data[k] = 0;
+        
+        if (entry->data != NULL) 
+        {
+            for (k = 0; (k < entry->data_length) && (k < 8); k++)CAN_WMessage.data[k] = entry->data[k];
+        } 
+        else if (entry->callback != NULL) 
+        {
+            entry->callback(&CAN_WMessage);
+        }
+        
+        (void)CAN_SendBufferPut(entry->ch, &CAN_WMessage);
+    }
+}
+
+
+
+/**
+ * @brief   Get the send statistic of the specified channel.
+ * @param   CANx, CAN channel number.
+ *          *stat, Store the send statistic.
+ * @attention XGATE may update the statistic at any time.The copy is taken again until the sequence
+ *            counter is even and has not changed during the copy.The queue latencies are only 
+ *            measured when CAN_FRAME_TIMESTAMP is defined.
+ * @returns 0: Calling succeeded.
+ * 			-1: Calling failed.
+ */
+int16_t CAN_GetSendStatistic(MSCAN_ChannelTypeDef CANx, CANSendStatistic_TypeDef* stat) 
+{
+    uint16_t seq;
+    
+    if ((CANx < MSCAN_Channel0) || (CANx > MSCAN_Channel4))return -1;
+    
+    if (NULL == stat)return -1;
+    
+    do 
+    {
+        seq   = g_CANx_SendBuffer.stat[CANx].seq;
+        *stat = g_CANx_SendBuffer.stat[CANx];
+    }while ((seq != g_CANx_SendBuffer.stat[CANx].seq) || ((seq & 1u) != 0));
+    
+    return 0;
+}
+
+
+
+/**
+ * @brief   Build the dispatch key of a CAN ID.
+ * @param   CANx, CAN channel number.
+ *          ext, 1 for an extended ID.
+ *          id, The CAN ID value.
+ * @returns The dispatch key.
+ */
+static uint32_t CAN_DispatchKey(MSCAN_ChannelTypeDef CANx, uint8_t ext, uint32_t id) 
+{
+    return ((uint32_t)CANx << 30) | ((ext != 0) ? 0x20000000u : 0u) | (id & CAN_FRAME_ID_MASK);
+}
+
+
+
+/**
+ * @brief   Register a handler for the messages of a channel whose ID matches id in all bits
+ *          which are cleared in id_mask.
+ * @param   CANx, CAN channel number.
+ *          id_format, ID format of the messages.
+ *          frame_type, Frame types of the messages,the other frames of the range are discarded.
+ *          id, The CAN ID.
+ *          id_mask, Ignored low ID bits,it must be zero or a run of low bits like 0xFF.
+ *          handler, The handler.
+ * @attention The table is kept sorted by inserting the new range at its place,which is only 
+ *            done at initialization.The handlers are called by CAN_DispatchReceiveBuffer().
+ *            Data and remote frames of one ID share the range,so they can only have one handler.
+ * @returns 0: Calling succeeded.
+ * 			-1: Calling failed.The parameters are invalid,the table is full or the ID range 
+ *              overlaps a registered one.
+ */
+int16_t CAN_RegisterHandler(MSCAN_ChannelTypeDef CANx, AcceptIDFormat id_format, AcceptFrameType frame_type, uint32_t id, uint32_t id_mask, CAN_MessageHandler handler) 
+{
+    uint8_t i;
+    
+    uint32_t low,high;
+    
+    if ((CANx < MSCAN_Channel0) || (CANx > MSCAN_Channel4))return -1;
+    
+    if ((NULL == handler) || ((id_mask & (id_mask + 1)) != 0))return -1;
+    
+    if ((frame_type < OnlyAcceptRemoteFrame) || (frame_type > AcceptBothFrame))return -1;
+    
+    if (id_format == OnlyAcceptStandardID) 
+    {
+        if ((id > 0x7FFu) || (id_mask > 0x7FFu))return -1;
+    } 
+    else if (id_format == OnlyAcceptExtendedID) 
+    {
+        if ((id > CAN_FRAME_ID_MASK) || (id_mask > CAN_FRAME_ID_MASK))return -1;
+    } 
+    else 
+    {
+        return -1;
+    }
+    
+    if (CAN_DispatchNum == CAN_DISPATCH_SIZE)return -1;
+    
+    low  = CAN_DispatchKey(CANx, id_format == OnlyAcceptExtendedID, id & ~id_mask);
+    high = low | id_mask;
+    
+    /* Move the ranges behind the new one up by one entry. */
+    for (i = CAN_DispatchNum; (i != 0) && (CAN_DispatchTable[i - 1].key_low > low); i--) 
+    {
+        CAN_DispatchTable[i] = CAN_DispatchTable[i - 1];
+    }
+    
+    if (((i != 0) && (CAN_DispatchTable[i - 1].key_high >= low))
+     || ((i != CAN_DispatchNum) && (CAN_DispatchTable[i + 1].key_low <= high))) 
+    {
+        /* Overlap,undo the move. */
+        for (; i < CAN_DispatchNum; i++) 
+        {
+            CAN_DispatchTable[i] = CAN_DispatchTable[i + 1];
+        }
+        
+        return -1;
+    }
+    
+    CAN_DispatchTable[i].key_low    = low;
+    CAN_DispatchTable[i].key_high   = high;
+    CAN_DispatchTable[i].frame_type = frame_type;
+    CAN_DispatchTable[i].handler    = handler;
+    
+    CAN_DispatchNum++;
+    
+    return 0;
+}
+
+
+
+/**
+ * @brief   Get up to max_num CAN messages out of the specified CAN receive buffer and call the 
+ *          registered handler of each of them.
+ * @param   CANx, CAN channel number.
+ *          max_num, Maximum number of CAN messages to be read.
+ * @attention The handler is found by a binary search for the last range which starts at or 
+ *            before the key of the message.A message without a handler,or of a frame type the 
+ *            handler did not register for,is discarded.
+ * @returns >=0: The number of CAN messages which have been read.
+ * 			-1: Calling failed.
+ */
+int16_t CAN_DispatchReceiveBuffer(MSCAN_ChannelTypeDef CANx, uint8_t max_num) 
+{
+    uint8_t lo,hi,mid,remote;
+    uint8_t count = 0;
+    
+    uint32_t key;
+    
+    MSCAN_MessageTypeDef msg;
+    
+    if ((CANx < MSCAN_Channel0) || (CANx > MSCAN_Channel4))return -1;
+    
+    while ((count < max_num) && (Check_CANReceiveBuffer(CANx, &msg) == 0)) 
+    {
+        count++;
+        
+        key = CAN_DispatchKey(CANx, (msg.frametype == DataFrameWithExtendedId) 
+                                 || (msg.frametype == RemoteFrameWithExtendedId), msg.frame_id);
+        
+        /* Entries below lo start at or before the key,entries from hi on start after it. */
+        lo = 0;
+        hi = CAN_DispatchNum;
+        
+        while (lo < hi) 
+        {
+            mid = (uint8_t)(lo + hi) >> 1;
+            
+            if (CAN_DispatchTable[mid].key_low <= key)lo = mid + 1;
+            else hi = mid;
+        }
+        
+        if ((lo == 0) || (key > CAN_DispatchTable[lo - 1].key_high))continue;
+        
+        remote = (msg.frametype == RemoteFrameWithStandardId) || (msg.frametype == RemoteFrameWithExtendedId);
+        
+        if (CAN_DispatchTable[lo - 1].frame_type == (remote ? OnlyAcceptDataFrame : OnlyAcceptRemoteFrame))continue;
+        
+        CAN_DispatchTable[lo - 1].handler(CANx, &msg);
+    }
+    
+    return (int16_t)count;
+}
+
+
+
+/**
+ * @brief   Set the task which is triggered when XGATE stores frames into the receive buffer.
+ * @param   CANx, CAN channel number.
+ *          task_id, The task ID returned by SystemTask_Create(),-1 to remove the task.
+ * @attention The task should drain the receive buffer,because it is triggered once for all the
+ *            frames which have arrived since the receive event was handled.
+ * @returns 0: Calling succeeded.
+ * 			-1: Calling failed.
+ */
+int16_t CAN_SetReceiveTask(MSCAN_ChannelTypeDef CANx, int16_t task_id) 
+{
+    if ((CANx < MSCAN_Channel0) || (CANx > MSCAN_Channel4))return -1;
+    
+    if ((task_id < -1) || (task_id >= SYSTEM_TASK_NUM))return -1;
+    
+    CAN_ReceiveTask[CANx] = task_id;
+    
+    return 0;
+}
+
+
+
+/**
+ * @brief   Trigger the receive tasks of the channels with a receive event.
+ * @param   None
+ * @attention This function must be called by the CPU interrupt service routine of XGATE software
+ *            trigger 2.The trigger is cleared before the flags are read,so a frame stored after
+ *            its flag is cleared raises a new interrupt.A flag which XGATE sets again while it is
+ *            cleared here is lost,but its frame was already stored and the task runs after this.
+ * @returns None
+ */
+void CAN_ReceiveEvent_Handler(void) 
+{
+    uint8_t ch;
+    
+    XGSWT = CAN_RECEIVE_EVENT_CLEAR;
+    
+    for (ch = 0; ch < CAN_CHANNEL_NUM; ch++) 
+    {
+        if (g_CANx_RecBuffer.event[ch] == 0)continue;
+        
+        g_CANx_RecBuffer.event[ch] = 0;
+        
+        if (CAN_ReceiveTask[ch] >= 0)(void)SystemTask_Trigger(CAN_ReceiveTask[ch]);
     }
 }
 
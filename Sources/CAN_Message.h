@@ -42,66 +42,365 @@
 
 /* Exported types ------------------------------------------------------------*/
 
-/* Global intranet, ECU, charger receive buffer size definition which will be used by CPU core and XGATE */
-#define   INTRANET_RECEIVEBUF_SIZE    (70)
-#define   ECU_RECEIVEBUF_SIZE         (10)
-#define   CHARGER_RECEIVEBUF_SIZE     (10)
+/* 
+   Soft CAN buffer depth of each channel,they are collected with the receive overflow policies in the 
+   channel configuration table of CAN_Message.c.Every depth must be a power of two from 2 to 128,so 
+   the ring indexes wrap with a mask.The depths and the resulting PAGED_RAM usage are checked at 
+   compile time.
+*/
+#define   INTRANET_RECEIVEBUF_SIZE    (64)             /* MSCAN_Channel0: system intranet */
+#define   ECU_RECEIVEBUF_SIZE         (16)             /* MSCAN_Channel1: ECU */
+#define   CHARGER_RECEIVEBUF_SIZE     (16)             /* MSCAN_Channel4: charger */
 
-/* Global intranet, ECU, charger receive buffer size definition which will just be used by CPU core */
-#define   INTRANET_SENDBUF_SIZE       (30)
-#define   ECU_SENDBUF_SIZE            (30)
-#define   CHARGER_SENDBUF_SIZE        (10)
+#define   INTRANET_SENDBUF_SIZE       (32)
+#define   ECU_SENDBUF_SIZE            (32)
+#define   CHARGER_SENDBUF_SIZE        (16)
 
+/* Number of MSCAN channels served by the soft CAN buffers,the channels are indexed by MSCAN_ChannelTypeDef */
+#define   CAN_CHANNEL_NUM             (3)
 
+/* Total number of frame slots in the receive and send frame pools */
+#define   CAN_RECEIVEBUF_TOTAL        (INTRANET_RECEIVEBUF_SIZE + ECU_RECEIVEBUF_SIZE + CHARGER_RECEIVEBUF_SIZE)
+#define   CAN_SENDBUF_TOTAL           (INTRANET_SENDBUF_SIZE + ECU_SENDBUF_SIZE + CHARGER_SENDBUF_SIZE)
 
 
-typedef struct 
+
+/* 
+   Define CAN_FRAME_RAW_ID to store the image of the MSCAN identifier registers IDR0..IDR3 in the
+   ID field of the packed CAN frame instead of the CAN ID value.XGATE then moves the identifier 
+   registers without any shifting,the application compares the ID field against constants built 
+   by CAN_FRAME_STD() and CAN_FRAME_EXT(),and the CAN ID value is only decoded by CAN_FrameId().
+*/
+/* #define   CAN_FRAME_RAW_ID */
+
+
+/* 
+   Define CAN_FRAME_TIMESTAMP to store the receive time stamp in every packed CAN frame.The time stamp
+   is the microsecond system time when XGATE takes the frame from the RxFG,the time between two frames
+   is the difference of their time stamps modulo 2^32.The send buffers keep the time of 
+   Fill_CANSendBuffer() in the same word for the queue latency statistic.
+   The time stamp makes every slot of the receive and send buffers 4 bytes longer,so it is off by 
+   default to keep the RAM saving of the packed frames.
+*/
+/* #define   CAN_FRAME_TIMESTAMP */
+
+
+#define   CAN_FRAME_ID_MASK           (0x1FFFFFFFu)    /* Maximum CAN ID value */
+
+#ifdef CAN_FRAME_RAW_ID
+
+/* ID field of the packed CAN frame,which is the image of the identifier registers */
+#define   CAN_FRAME_STD(id, rtr)      CAN_IDR_STD(id, rtr)
+#define   CAN_FRAME_EXT(id, rtr)      CAN_IDR_EXT(id, rtr)
+#define   CAN_FRAME_IS_EXT(fid)       (((fid) & CAN_IDR_IDE) != 0)
+#define   CAN_FRAME_IS_RTR(fid)       (((fid) & (CAN_FRAME_IS_EXT(fid) ? 0x00000001u : 0x00100000u)) != 0)
+
+#else
+
+/* ID bits of the packed CAN frame */
+#define   CAN_FRAME_IDE               (0x80000000u)    /* 1: Extended ID; 0: Standard ID */
+#define   CAN_FRAME_RTR               (0x40000000u)    /* 1: Remote frame; 0: Data frame */
+
+/* ID field of the packed CAN frame,which is the CAN ID value with the IDE and RTR bits */
+#define   CAN_FRAME_STD(id, rtr)      ((uint32_t)(id) | ((rtr) ? CAN_FRAME_RTR : 0u))
+#define   CAN_FRAME_EXT(id, rtr)      ((uint32_t)(id) | CAN_FRAME_IDE | ((rtr) ? CAN_FRAME_RTR : 0u))
+#define   CAN_FRAME_IS_EXT(fid)       (((fid) & CAN_FRAME_IDE) != 0)
+#define   CAN_FRAME_IS_RTR(fid)       (((fid) & CAN_FRAME_RTR) != 0)
+
+#endif
+
+
+
+/* 
+   Packed CAN frame stored in the soft CAN buffers.The ID format and the frame type are folded
+   into the ID field,so a frame takes 14 bytes instead of the 16 bytes of MSCAN_MessageTypeDef 
+   without its time stamp,or 18 bytes with CAN_FRAME_TIMESTAMP.The size is kept even because XGATE
+   accesses words at even addresses only.
+   The frames are converted from and to MSCAN_MessageTypeDef by the buffer functions.
+*/
+typedef struct
 {
-    uint8_t Charger_SendBuff_WPointer;
-    uint8_t Charger_SendBuff_RPointer;
-    
-    uint8_t Intranet_SendBuff_WPointer;
-    uint8_t Intranet_SendBuff_RPointer;
-    
-    uint8_t ECU_SendBuff_WPointer;
-    uint8_t ECU_SendBuff_RPointer;
+    uint8_t  data[8];                          /* 8 bytes data */
+    uint32_t id;                               /* ID field,built by CAN_FRAME_STD() or CAN_FRAME_EXT() */
+#ifdef CAN_FRAME_TIMESTAMP
+    uint32_t time;                             /* Receive time in microseconds,or the time of Fill_CANSendBuffer() in the send buffers */
+#endif
+    uint8_t  dlc;                              /* Data length,0..8 */
+    uint8_t  reserved;
+}CANFrame_TypeDef;
+
+
+
+/* 
+   Soft CAN buffer descriptor of one channel.Each buffer is a single producer/single consumer ring,
+   the write pointer is only changed by the producer and the read pointer is only changed by the 
+   consumer,except when XGATE drops an unread frame under the receive semaphore.
+   Both pointers are free running 8 bit counters and the slot is the pointer masked by the depth.
+   The buffer is empty when both pointers are equal and full when the write pointer is one depth
+   ahead of the read pointer,so all slots are used and no wrap compare is needed.
+   The slots are located through an index into the frame pool instead of an address,because CPU core
+   and XGATE see the paged RAM at different addresses.
+*/
+typedef struct
+{
+    uint8_t WPointer;                          /* Free running write pointer,only changed by the producer. */
+    uint8_t RPointer;                          /* Free running read pointer,only changed by the consumer. */
+    uint8_t base;                              /* Index of the first slot of this channel in the frame pool. */
+    uint8_t mask;                              /* Number of slots of this channel minus one,the number is a power of two. */
+}CANBufferDescriptor_TypeDef;
+
+
+
+/* What XGATE does with a new frame when the receive buffer of the channel is full */
+typedef enum
+{
+    CAN_DropNewest = 0,                        /* The new frame is dropped,the unread frames are kept. */
+    CAN_DropOldest,                            /* The oldest unread frame is dropped to store the new frame. */
+    CAN_OverwriteLatest,                       /* The newest unread frame is overwritten by the new frame. */
+}CAN_OverflowPolicyTypeDef;
+
+
+/* Which received frames XGATE stores after they passed the MSCAN hardware filters */
+typedef enum
+{
+    CAN_SoftFilterOff = 0,                     /* Every frame is stored. */
+    CAN_SoftFilterId,                          /* Only frames with an ID of the accept list are stored. */
+    CAN_SoftFilterJ1939,                       /* Like CAN_SoftFilterId,but an extended ID is compared by its J1939 PGN. */
+}CAN_SoftFilterTypeDef;
+
+
+/* Soft CAN buffer configuration of one channel */
+typedef struct
+{
+    uint8_t receive_size;                      /* Depth of the receive buffer */
+    uint8_t send_size;                         /* Depth of the send buffer */
+    CAN_OverflowPolicyTypeDef policy;          /* Receive overflow policy */
+    CAN_SoftFilterTypeDef soft_filter;         /* Software acceptance filter */
+}CANChannelConfig_TypeDef;
+
+
+/* XGATE hardware semaphore which guards the read pointer of a receive buffer,see CAN_OverflowPolicyTypeDef */
+#define   CAN_RECEIVE_SEMAPHORE(ch)   ((uint8_t)(ch))
+
+/* Number of frames which CPU core copies per hold of the receive semaphore in a batch read */
+#define   CAN_RECEIVE_BATCH_CHUNK     (4)
+
+
+/* 
+   Receive event.When XGATE stores a frame into the receive buffer of a channel whose event flag is
+   clear,it sets the flag and raises XGATE software trigger 2,which is routed to CPU core.No trigger is
+   raised while the flag is set,and the trigger stays pending until CPU core clears it,so a burst of 
+   frames causes a single interrupt.Frames stored into a mailbox raise no receive event,they are read
+   by CAN_ReadMailbox() when CPU core needs them.
+*/
+#define   CAN_RECEIVE_EVENT_SET       (0x0404u)        /* XGSWT value which sets software trigger 2 */
+#define   CAN_RECEIVE_EVENT_CLEAR     (0x0400u)        /* XGSWT value which clears software trigger 2 */
+
+
+
+/* Receive statistic of one channel.XGATE updates the counters and CPU core reads them. */
+typedef struct
+{
+    uint16_t drop_count;                       /* Number of frames lost because the receive buffer was full,saturates at 0xFFFF. */
+    uint16_t reject_count;                     /* Number of frames rejected by the software acceptance filter,saturates at 0xFFFF. */
+    uint8_t  high_water;                       /* Maximum number of unread frames since initialization. */
+    uint8_t  policy;                           /* Overflow policy,CAN_OverflowPolicyTypeDef. */
+    uint16_t entry_count;                      /* Number of receive handler entries which took a frame. */
+    uint16_t frame_count;                      /* Number of frames taken by these entries,both stop when it saturates. */
+    uint8_t  burst_max;                        /* Maximum number of frames taken in one entry. */
+    uint8_t  reserved;
+}CANReceiveStatistic_TypeDef;
+
+
+
+/* 
+   Software acceptance filter.The frames which pass the MSCAN hardware filters but are not wanted
+   are dropped by XGATE before they take a slot of the receive buffer.
+   A standard ID is looked up in a bitmap of all 2048 IDs.An extended ID,or its J1939 PGN,is looked
+   up in an open addressing hash table with linear probing.CAN_MessageBuffer_Init() builds both from
+   the accept list of CAN_Message.c and records the longest probe sequence,so the lookup time of 
+   XGATE is bounded and does not depend on the number of accepted IDs.
+*/
+#define   CAN_SOFTFILTER_HASH_SIZE    (64)             /* Hash table entries of each channel,a power of two */
+
+#define   CAN_SOFTFILTER_VALID        (0x80000000u)    /* Set in a used hash table entry */
+
+/* Hash table index of a 29 bit key */
+#define   CAN_SOFTFILTER_HASH(key)    ((uint8_t)((key) ^ ((key) >> 8) ^ ((key) >> 16)) & (CAN_SOFTFILTER_HASH_SIZE - 1))
+
+/* 
+   J1939 PGN of an extended ID.The PDU specific byte of a PDU1 PGN (PDU format below 240) is the 
+   destination address,so it is cleared and the frame is accepted for every destination.
+*/
+#define   CAN_J1939_PGN(id)           ((((uint32_t)(id) >> 8) & 0x3FF00u) \
+                                     | ((((uint32_t)(id) >> 16) & 0xFFu) >= 0xF0u ? (((uint32_t)(id) >> 8) & 0xFFu) : 0u))
+
+
+/* One entry of the accept list of the software acceptance filter */
+typedef struct
+{
+    MSCAN_ChannelTypeDef ch;                   /* CAN channel number */
+    AcceptIDFormat id_format;                  /* ID format */
+    uint32_t id;                               /* CAN ID,any ID of the PGN on a CAN_SoftFilterJ1939 channel */
+}CANAcceptId_TypeDef;
+
+
+/* Lookup tables of the software acceptance filter.CPU core builds them and XGATE only reads them. */
+typedef struct
+{
+    uint8_t  std_map[CAN_CHANNEL_NUM][256];                        /* Bit n is set when standard ID n is accepted */
+    uint32_t ext_hash[CAN_CHANNEL_NUM][CAN_SOFTFILTER_HASH_SIZE];  /* Accepted keys with CAN_SOFTFILTER_VALID,zero when unused */
+    uint8_t  mode[CAN_CHANNEL_NUM];                                /* CAN_SoftFilterTypeDef */
+    uint8_t  probe[CAN_CHANNEL_NUM];                               /* Longest probe sequence in ext_hash minus one */
+}CANSoftFilter_TypeDef;
+
+
+
+/* 
+   Send statistic of one channel.The queue latency of a message is the time from Fill_CANSendBuffer()
+   to the end of its transmission in microseconds.The histogram bins are taken from the latency 
+   shifted right by CAN_TXLATENCY_SHIFT,bin 0 counts the shifted latency 0,bin n the shifted latencies
+   2^(n-1)..2^n-1 and the last bin all longer latencies.XGATE updates the statistic and the sequence
+   counter is odd during the update,CPU core reads it with CAN_GetSendStatistic().
+*/
+#define   CAN_TXLATENCY_BINS          (16)
 
-    MSCAN_MessageTypeDef Charger_SendBuff[CHARGER_SENDBUF_SIZE]; 
+#define   CAN_TXLATENCY_SHIFT         (4)              /* Bin 0 holds the latencies below 16us */
+
+typedef struct
+{
+    uint16_t seq;                              /* Sequence counter,odd while XGATE updates the statistic */
+    uint32_t min;                              /* Minimum queue latency */
+    uint32_t max;                              /* Maximum queue latency */
+    uint32_t count;                            /* Number of sent messages */
+    uint32_t sum;                              /* Sum of the queue latencies,sum / count is the average */
+    uint16_t hist[CAN_TXLATENCY_BINS];         /* Histogram of the queue latencies,each bin saturates at 0xFFFF */
+}CANSendStatistic_TypeDef;
+
+
+
+/* Soft CAN send buffers.CPU core is the producer and XGATE is the consumer,which takes the messages by the CAN ID priority. */
+typedef struct 
+{
+    CANBufferDescriptor_TypeDef ch[CAN_CHANNEL_NUM];
     
-    MSCAN_MessageTypeDef Intranet_SendBuff[INTRANET_SENDBUF_SIZE]; 
+    CANSendStatistic_TypeDef stat[CAN_CHANNEL_NUM];
     
-    MSCAN_MessageTypeDef ECU_SendBuff[ECU_SENDBUF_SIZE];  
+    CANFrame_TypeDef SendBuff[CAN_SENDBUF_TOTAL];
         
 }CANSendMessagebuffer_TypeDef;
 
 
 
-
+/* Soft CAN receive buffers.XGATE is the producer and CPU core is the consumer. */
 typedef struct 
 {
-    uint8_t Intranet_RecBuff_WPointer;
-    uint8_t Intranet_RecBuff_RPointer;
-    
-    uint8_t ECU_RecBuff_WPointer;
-    uint8_t ECU_RecBuff_RPointer;
-    
-    uint8_t Charger_RecBuff_WPointer;
-    uint8_t Charger_RecBuff_RPointer;
+    CANBufferDescriptor_TypeDef ch[CAN_CHANNEL_NUM];
     
-    MSCAN_MessageTypeDef Intranet_RecBuf[INTRANET_RECEIVEBUF_SIZE];
+    CANReceiveStatistic_TypeDef stat[CAN_CHANNEL_NUM];
     
-    MSCAN_MessageTypeDef ECU_RecBuf[ECU_RECEIVEBUF_SIZE];
+    CANFrame_TypeDef RecBuf[CAN_RECEIVEBUF_TOTAL];
     
-    MSCAN_MessageTypeDef Charger_RecBuf[CHARGER_RECEIVEBUF_SIZE];
+    uint8_t event[CAN_CHANNEL_NUM];            /* Receive event flags,set by XGATE and cleared by CPU core */
     
 }CANReceiveMessageBuffer_TypeDef;
 
 
 
+/* 
+   Mailboxes for cyclic messages.A data frame whose ID is in the mailbox list of CAN_Message.c is not
+   queued,XGATE overwrites the mailbox of that ID instead,so repeated frames use constant memory and
+   never push event frames out of the receive buffer.The sequence counter is odd while XGATE writes
+   the mailbox,CPU core copies the mailbox and retries until it read the same even counter before
+   and after the copy.
+*/
+#define   CAN_MAILBOX_NUM             (8)              /* Maximum number of mailboxes of all channels */
+
+
+/* Mailbox of one ID */
+typedef struct
+{
+    CANFrame_TypeDef frame;                    /* Latest received frame */
+    uint16_t seq;                              /* Sequence counter,increased by 2 for each frame,zero until the first frame */
+}CANMailbox_TypeDef;
+
+
+/* Mailboxes of all channels.CPU core builds the keys,XGATE writes the mailboxes. */
+typedef struct
+{
+    uint32_t key[CAN_MAILBOX_NUM];             /* ID field of the mailbox,built by CAN_FRAME_STD() or CAN_FRAME_EXT() */
+    uint8_t  first[CAN_CHANNEL_NUM];           /* First mailbox of each channel */
+    uint8_t  num[CAN_CHANNEL_NUM];             /* Number of mailboxes of each channel */
+    CANMailbox_TypeDef box[CAN_MAILBOX_NUM];
+}CANMailboxTable_TypeDef;
+
+
+
+/* 
+   Receive dispatch.Handlers are registered per channel for an ID and a mask of ignored low ID bits,
+   which must be a run of low bits such as 0xFF for the J1939 source address.The registered ranges 
+   are kept sorted and must not overlap,so a frame finds its handler by binary search and the 
+   dispatch cost grows only with the logarithm of the number of handlers.
+*/
+#define   CAN_DISPATCH_SIZE           (32)             /* Maximum number of registered handlers of all channels */
+
+/* Handler of received CAN messages,it runs in the context of CAN_DispatchReceiveBuffer() */
+typedef void (*CAN_MessageHandler)(MSCAN_ChannelTypeDef CANx, MSCAN_MessageTypeDef* CAN_RMessage);
+
+
+/* 
+   One registered ID range.The key holds the channel in bits 31..30,the IDE bit in bit 29 and the ID.
+   The key has no room for the RTR bit,so the entry records which frame types its handler takes.
+*/
+typedef struct
+{
+    uint32_t key_low;                          /* First key of the range */
+    uint32_t key_high;                         /* Last key of the range */
+    AcceptFrameType frame_type;                /* Frame types passed to the handler */
+    CAN_MessageHandler handler;
+}CANDispatchEntry_TypeDef;
+
+
+
+/* 
+   Cyclic messages.The schedule table in CAN_Message.c lists the messages which CAN_CyclicSchedule()
+   sends every period RTI ticks,the first time offset ticks after the start.The payload is copied from
+   data,or built by the callback when data is NULL,the bytes which neither of them sets are sent as
+   zeros.An offset of CAN_CYCLIC_AUTO_OFFSET lets the schedule pick the phase which collides with the
+   fewest messages already placed,so that messages of the same period are spread over the ticks 
+   instead of bursting together.The schedule is the only producer of the send buffers of the channels
+   in its table,Fill_CANSendBuffer() refuses these channels.
+*/
+#define   CAN_CYCLIC_NUM              (16)             /* Maximum number of cyclic messages of all channels */
+
+#define   CAN_CYCLIC_AUTO_OFFSET      (0xFFFFu)
+
+/* Payload builder of a cyclic message,it runs in the context of RTI_ISR and must be short */
+typedef void (*CAN_CyclicCallback)(MSCAN_MessageTypeDef* CAN_WMessage);
+
+
+typedef struct
+{
+    MSCAN_ChannelTypeDef ch;
+    MSCAN_FrameAndIDTypeDef frametype;
+    uint32_t id;
+    uint16_t period;                           /* Period in RTI ticks,zero disables the message */
+    uint16_t offset;                           /* First send tick,less than period,or CAN_CYCLIC_AUTO_OFFSET */
+    uint8_t data_length;
+    const uint8_t* data;                       /* Constant payload,or NULL to use the callback */
+    CAN_CyclicCallback callback;
+}CANCyclicMessage_TypeDef;
+
+
+
 #pragma DATA_SEG __GPAGE_SEG PAGED_RAM
 
 extern volatile CANSendMessagebuffer_TypeDef g_CANx_SendBuffer;
 
+extern volatile CANSoftFilter_TypeDef g_CAN_SoftFilter;
+
+extern volatile CANMailboxTable_TypeDef g_CAN_Mailbox;
+
 #pragma DATA_SEG DEFAULT
 
 
@@ -111,13 +410,46 @@ extern "C" {
 
 /* Exported functions ------------------------------------------------------- */
 
+void CAN_MessageBuffer_Init(void);
+
+
 int16_t Check_CANReceiveBuffer(MSCAN_ChannelTypeDef CANx, MSCAN_MessageTypeDef* CAN_RMessage);
 
 
+int16_t Check_CANReceiveBuffer_Batch(MSCAN_ChannelTypeDef CANx, MSCAN_MessageTypeDef* CAN_RMessage, uint8_t max_num);
+
+
+int16_t Check_CANReceiveFrame(MSCAN_ChannelTypeDef CANx, CANFrame_TypeDef* CAN_RFrame);
+
+
+uint32_t CAN_FrameId(uint32_t fid);
+
+
+int16_t CAN_ReadMailbox(MSCAN_ChannelTypeDef CANx, AcceptIDFormat id_format, uint32_t id, MSCAN_MessageTypeDef* CAN_RMessage, uint16_t* seq);
+
+
+int16_t CAN_GetReceiveStatistic(MSCAN_ChannelTypeDef CANx, CANReceiveStatistic_TypeDef* stat);
+
+
 int16_t Fill_CANSendBuffer(MSCAN_ChannelTypeDef CANx, MSCAN_MessageTypeDef* CAN_WMessage);
 
 
-int16_t Check_CANSendBuffer(MSCAN_ChannelTypeDef CANx, MSCAN_MessageTypeDef* CAN_RMessage);
+int16_t CAN_GetSendStatistic(MSCAN_ChannelTypeDef CANx, CANSendStatistic_TypeDef* stat);
+
+
+void CAN_CyclicSchedule(void);
+
+
+int16_t CAN_RegisterHandler(MSCAN_ChannelTypeDef CANx, AcceptIDFormat id_format, AcceptFrameType frame_type, uint32_t id, uint32_t id_mask, CAN_MessageHandler handler);
+
+
+int16_t CAN_DispatchReceiveBuffer(MSCAN_ChannelTypeDef CANx, uint8_t max_num);
+
+
+int16_t CAN_SetReceiveTask(MSCAN_ChannelTypeDef CANx, int16_t task_id);
+
+
+void CAN_ReceiveEvent_Handler(void);
 
 
 
@@ -43,13 +43,8 @@
 
 void interrupt VectorNumber_Vrti RTI_ISR(void)
 {
-    static uint8_t Time_Count = 0;
-    
-    int16_t ret_val;
-    
-    MSCAN_MessageTypeDef S_Message;
-    MSCAN_ModuleConfig CANx_Module;
-   
+	SYSTEM_PROFILE_ENTER(Profile_RTI_ISR);
+	
 	if (CRGFLG_RTIF)
 	{
 		/* Clear the RTI interrupt flag by writing 1 to it */
@@ -58,66 +53,38 @@ void interrupt VectorNumber_Vrti RTI_ISR(void)
 		/* Call time delay decrement function */
 		TimeDelay_Decrement();
 		
-		Time_Count++;
+		/* Mark the tasks which are due */
+		SystemTask_Tick();
 		
-		if (Time_Count >= 50) /* Delay 500ms time is arrived */
-		{
-		    Time_Count = 0;
-		    
-		    CANx_Module.ch   = MSCAN_Channel0;
-            CANx_Module.pins = MSCAN0_PM0_PM1;
-            
-		    /* Checking whether CAN module have enough TX buffer to send CAN message. */
-		    if (MSCAN_HardTxBufferCheck(MSCAN_Channel0) == 0) 
-		    {
-    		    /* Checking soft CAN TX buffer have valid CAN message. */
-    		    ret_val = Check_CANSendBuffer(MSCAN_Channel0, &S_Message);
-    		    
-    		    /* If yes,load the read CAN message and send it. */
-    		    if (ret_val == 0) 
-    		    {
-    		        (void)MSCAN_SendFrame(&CANx_Module, &S_Message);
-    		    } 		        
-		    }
-		    
-		    
-		    CANx_Module.ch   = MSCAN_Channel1;
-            CANx_Module.pins = MSCAN1_PM2_PM3;
-            
-		    /* Checking whether CAN module have enough TX buffer to send CAN message. */
-		    if (MSCAN_HardTxBufferCheck(MSCAN_Channel1) == 0) 
-		    {
-    		    /* Checking soft CAN TX buffer have valid CAN message. */
-    		    ret_val = Check_CANSendBuffer(MSCAN_Channel1, &S_Message);
-    		    
-    		    /* If yes,load the read CAN message and send it. */
-    		    if (ret_val == 0) 
-    		    {
-    		        (void)MSCAN_SendFrame(&CANx_Module, &S_Message);
-    		    } 		        
-		    }
-		    
-		    
-		    CANx_Module.ch   = MSCAN_Channel4;
-            CANx_Module.pins = MSCAN4_PM4_PM5;
-            
-		    /* Checking whether CAN module have enough TX buffer to send CAN message. */
-		    if (MSCAN_HardTxBufferCheck(MSCAN_Channel4) == 0) 
-		    {
-    		    /* Checking soft CAN TX buffer have valid CAN message. */
-    		    ret_val = Check_CANSendBuffer(MSCAN_Channel4, &S_Message);
-    		    
-    		    /* If yes,load the read CAN message and send it. */
-    		    if (ret_val == 0) 
-    		    {
-    		        (void)MSCAN_SendFrame(&CANx_Module, &S_Message);
-    		    } 		        
-		    }
-		}
+		/* Send the cyclic CAN messages which are due */
+		CAN_CyclicSchedule();
 	}
+	
+	SYSTEM_PROFILE_EXIT(Profile_RTI_ISR);
 }
 
 
+
+void interrupt VectorNumber_Vectovf ECT_Overflow_ISR(void)
+{
+	/* Count the high word of the microsecond system time */
+	SystemTime_Overflow();
+}
+
+
+
+void interrupt VectorNumber_Vxst2 XGATE_SoftwareTrigger2_ISR(void)
+{
+	SYSTEM_PROFILE_ENTER(Profile_ReceiveEvent);
+	
+	/* XGATE has stored new CAN frames,trigger the receive tasks */
+	CAN_ReceiveEvent_Handler();
+	
+	SYSTEM_PROFILE_EXIT(Profile_ReceiveEvent);
+}
+
+
+
 /* Add your interrupt service routines here. */
 
 
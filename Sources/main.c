@@ -77,6 +77,30 @@ word XGATE_STACK_H[1];
 
 #define   MSCAN4RECEIVE_VEC     0x92      /* MSCAN4 receive interrupt vector address.(0x49 * 2 = 0x92) */
 
+#define   SOFTWARETRIGGER1_VEC  0x70      /* Software trigger 1 vector address,used to start CAN transmission.(0x38 * 2 = 0x70) */
+
+#define   SOFTWARETRIGGER2_VEC  0x6E      /* Software trigger 2 vector address,used by XGATE to signal received frames.(0x37 * 2 = 0x6E) */
+
+#define   MSCAN0TRANSMIT_VEC    0xB0      /* MSCAN0 transmit interrupt vector address.(0x58 * 2 = 0xB0) */
+
+#define   MSCAN1TRANSMIT_VEC    0xA8      /* MSCAN1 transmit interrupt vector address.(0x54 * 2 = 0xA8) */
+
+#define   MSCAN4TRANSMIT_VEC    0x90      /* MSCAN4 transmit interrupt vector address.(0x48 * 2 = 0x90) */
+
+
+
+
+/* 
+   Wanted ID ranges of the charger channel,compiled into the MSCAN acceptance filters.The filters
+   pass the priority 6 J1939 frames of data page 0 and the software acceptance filter keeps the 
+   PGNs of CAN_AcceptList,so the other charger messages are counted in reject_count.
+*/
+static const MSCAN_FilterRangeTypeDef Charger_FilterList[] = 
+{
+    /* id_format             frame_type            id_low        id_high */
+    {OnlyAcceptExtendedID,   OnlyAcceptDataFrame,  0x18000000u,  0x18FFFFFFu},
+};
+
 
 
 
@@ -101,6 +125,16 @@ static void SetupXGATE(void)
     ROUTE_INTERRUPT(MSCAN1RECEIVE_VEC, 0x81); /* Configure CAN1 receive interrupt vector and priority in XGATE */
     
     ROUTE_INTERRUPT(MSCAN4RECEIVE_VEC, 0x81); /* Configure CAN4 receive interrupt vector and priority in XGATE */
+    
+    ROUTE_INTERRUPT(SOFTWARETRIGGER1_VEC, 0x81); /* Configure software trigger 1 vector and priority in XGATE */
+    
+    ROUTE_INTERRUPT(SOFTWARETRIGGER2_VEC, 0x01); /* RQST=0,software trigger 2 interrupts CPU core with priority 1 */
+    
+    ROUTE_INTERRUPT(MSCAN0TRANSMIT_VEC, 0x81); /* Configure CAN0 transmit interrupt vector and priority in XGATE */
+    
+    ROUTE_INTERRUPT(MSCAN1TRANSMIT_VEC, 0x81); /* Configure CAN1 transmit interrupt vector and priority in XGATE */
+    
+    ROUTE_INTERRUPT(MSCAN4TRANSMIT_VEC, 0x81); /* Configure CAN4 transmit interrupt vector and priority in XGATE */
 
     /* when changing your derivative to non-core3 one please remove next five lines */
     XGISPSEL= 1;
@@ -120,6 +154,36 @@ static void SetupXGATE(void)
 
 
 
+/**
+ * @brief   Handler of the charger status message.
+ * @param   CANx, CAN channel number.
+ *          *CAN_RMessage, The received CAN message.
+ * @returns None
+ */
+static void Charger_StatusHandler(MSCAN_ChannelTypeDef CANx, MSCAN_MessageTypeDef* CAN_RMessage) 
+{
+    GPIO_ToggleBit(GPIOT, GPIO_Pin6);
+}
+
+
+
+
+
+/**
+ * @brief   Task which drains the charger receive buffer.
+ * @param   None
+ * @returns None
+ */
+static void Charger_ReceiveTask(void) 
+{
+    /* Pass all the received frames of the charger channel to their handlers. */
+    (void)CAN_DispatchReceiveBuffer(MSCAN_Channel4, CHARGER_RECEIVEBUF_SIZE);
+}
+
+
+
+
+
 /**
  * @brief   System main loop function.
  * @param   None
@@ -128,69 +192,27 @@ static void SetupXGATE(void)
 void main(void) 
 {
 /* Local variable definition which will be used in the following program */
-    int16_t ret_val,k;
+    int16_t ret_val;
 
     MSCAN_ParametersConfig CAN_Property;
     MSCAN_FilterConfig CAN_Filter;
   
     MSCAN_ModuleConfig CAN_Module;
-    MSCAN_MessageTypeDef Send_Buf;
-    MSCAN_MessageTypeDef T_ReceiveBuf;
     
     DisableInterrupts;                               /* Disable total interrupt */
     
     SetupXGATE();                                    /* Initialize XGATE */
    
-    g_CANx_RecBuffer.Intranet_RecBuff_WPointer = 0;
-    g_CANx_RecBuffer.Intranet_RecBuff_RPointer = 0;
-    g_CANx_RecBuffer.ECU_RecBuff_WPointer      = 0;
-    g_CANx_RecBuffer.ECU_RecBuff_RPointer      = 0;
-    g_CANx_RecBuffer.Charger_RecBuff_WPointer  = 0;
-    g_CANx_RecBuffer.Charger_RecBuff_RPointer  = 0;
+    CAN_MessageBuffer_Init();                        /* Empty the soft CAN buffers */
     
-    for (k = 0; k < INTRANET_RECEIVEBUF_SIZE; k++) 
-    {
-        g_CANx_RecBuffer.Intranet_RecBuf[k].frametype = (MSCAN_FrameAndIDTypeDef)0;  
-    }
+    /* Register the handlers of the received messages */
+    ret_val = CAN_RegisterHandler(MSCAN_Channel4, OnlyAcceptExtendedID, OnlyAcceptDataFrame, 0x18901212u, 0, Charger_StatusHandler);
     
-    for (k = 0; k < ECU_RECEIVEBUF_SIZE; k++) 
-    {
-        g_CANx_RecBuffer.ECU_RecBuf[k].frametype      = (MSCAN_FrameAndIDTypeDef)0;
-    }
-    
-    for (k = 0; k < CHARGER_RECEIVEBUF_SIZE; k++) 
-    {   
-        g_CANx_RecBuffer.Charger_RecBuf[k].frametype  = (MSCAN_FrameAndIDTypeDef)0;
-    }
-    
-    g_CANx_SendBuffer.Intranet_SendBuff_WPointer = 0;
-    g_CANx_SendBuffer.Intranet_SendBuff_RPointer = 0;
-    g_CANx_SendBuffer.ECU_SendBuff_WPointer      = 0;
-    g_CANx_SendBuffer.ECU_SendBuff_RPointer      = 0;
-    g_CANx_SendBuffer.Charger_SendBuff_WPointer  = 0;
-    g_CANx_SendBuffer.Charger_SendBuff_RPointer  = 0;
-    
-    for (k = 0; k < INTRANET_SENDBUF_SIZE; k++) 
-    {
-        g_CANx_SendBuffer.Intranet_SendBuff[k].frametype = (MSCAN_FrameAndIDTypeDef)0; 
-    }
-    
-    for (k = 0; k < ECU_RECEIVEBUF_SIZE; k++) 
-    {
-        g_CANx_SendBuffer.ECU_SendBuff[k].frametype      = (MSCAN_FrameAndIDTypeDef)0;
-    }
-    
-    for (k = 0; k < CHARGER_RECEIVEBUF_SIZE; k++) 
-    {   
-        g_CANx_SendBuffer.Charger_SendBuff[k].frametype  = (MSCAN_FrameAndIDTypeDef)0;
-    }
-    
-
     
     /* Configure CAN module trnasfer property parameters */
     CAN_Property.baudrate                    = MSCAN_Baudrate_250K;
     CAN_Property.MSCAN_StopInWaitMode        = 0;
-    CAN_Property.MSCAN_TimeStampEnable       = 0;
+    CAN_Property.MSCAN_TimeStampEnable       = 0;    /* The receive time stamps are taken from the system time */
     CAN_Property.MSCAN_WakeUpEnable          = 1;
     CAN_Property.MSCAN_ModuleEnable          = 1;
     CAN_Property.MSCAN_ClockSource           = 0;
@@ -202,7 +224,7 @@ void main(void)
     CAN_Property.MSCAN_StatusChangeINTEnable = 0;
     CAN_Property.MSCAN_OverrunINTEnable      = 0;
     CAN_Property.MSCAN_ReceiveFullINTEnable  = 1;
-    CAN_Property.MSCAN_Trans0EmptyINTEnable  = 0;
+    CAN_Property.MSCAN_Trans0EmptyINTEnable  = 0;    /* Enabled on demand by XGATE transmit routine */
     CAN_Property.MSCAN_Trans1EmptyINTEnable  = 0;
     CAN_Property.MSCAN_Trans2EmptyINTEnable  = 0;
     
@@ -213,23 +235,15 @@ void main(void)
     CAN_Filter.frame_type     = OnlyAcceptDataFrame;
     CAN_Filter.id_mask        = 0xFFFFFFFFu; /* If this value is set to 0xFFFFFFFF,the id_accept value does not work */
     CAN_Filter.id_accept      = 0x18901212u;
-    
-    /* Configure CAN module Send data */ 
-    Send_Buf.frametype   = DataFrameWithExtendedId;
-    Send_Buf.frame_id    = 0x18f09234;
-    Send_Buf.data_length = 8;
-    Send_Buf.data[0]     = 0x29;
-    Send_Buf.data[1]     = 0x29;
-    Send_Buf.data[2]     = 0x29;
-    Send_Buf.data[3]     = 0x29;
-    Send_Buf.data[4]     = 0x29;
-    Send_Buf.data[5]     = 0x29;
-    Send_Buf.data[6]     = 0x29;
-    Send_Buf.data[7]     = 0x29;
+    CAN_Filter.id_list        = NULL;
+    CAN_Filter.id_num         = 0;        /* Zero selects the single filter above */
     
     /* Initialize sysytem clock and Bus clock frequency */
     ret_val = SystemClock_Init(BusClock_32MHz);
     
+    /* Start the microsecond system time */
+    ret_val = SystemTime_Init(BusClock_32MHz);
+    
     /* Select CAN module number and signal pins remap */
     CAN_Module.ch = MSCAN_Channel0;
     CAN_Module.pins = MSCAN0_PM0_PM1;
@@ -250,6 +264,10 @@ void main(void)
     CAN_Module.ch = MSCAN_Channel4;
     CAN_Module.pins = MSCAN4_PM4_PM5;
     
+    /* The charger channel accepts the ID ranges of its list only,the filter mode is chosen by the driver. */
+    CAN_Filter.id_list = Charger_FilterList;
+    CAN_Filter.id_num  = sizeof(Charger_FilterList) / sizeof(Charger_FilterList[0]);
+    
     /* Initialize MSCAN module by the specified property */
     ret_val = MSCAN_Init(&CAN_Module, &CAN_Property, &CAN_Filter);
     
@@ -258,24 +276,14 @@ void main(void)
     
     GPIO_Init(GPIOT, GPIO_Pin6, GPIO_Output);
     
-    EnableInterrupts;                                 /* Enable total interrupt */
-
-    for(;;) 
-    {  
-        Delay10ms(25);
-        
-       // ret_val = Fill_CANSendBuffer(MSCAN_Channel0, &Send_Buf);
-        
-        ret_val = Fill_CANSendBuffer(MSCAN_Channel4, &Send_Buf);
-
-        if (Check_CANReceiveBuffer(MSCAN_Channel4, &T_ReceiveBuf) == 0) 
-        {
-            if (T_ReceiveBuf.frame_id == 0x18901212u) 
-            {
-                T_ReceiveBuf.frame_id = 0;
-                
-                GPIO_ToggleBit(GPIOT, GPIO_Pin6);
-            }
-        }
-    }
+    /* The charger control message is sent by the cyclic schedule in RTI_ISR. */
+    
+    /* Drain the charger receive buffer as soon as XGATE signals new frames */
+    ret_val = CAN_SetReceiveTask(MSCAN_Channel4, SystemTask_Create(Charger_ReceiveTask, 0, 0));
+    
+    /* 
+    Run the tasks for ever.The interrupts have been enabled by SystemClock_Init(),the scheduler 
+    only masks them briefly to pick a task or to enter WAI.
+    */
+    SystemTask_Run();
 }
@@ -16,7 +16,22 @@
   *           3. Add a functon which is Checking the specified CAN module whether 
   *              have enough hard transmission buffer to send CAN messages. (V1.0.2)
   *           4. Change CAN message structure definetion.                   (V1.0.3)
-  * @version: V1.0.2
+  *           5. Add a function which enables or disables the transmitter
+  *              empty interrupts.                                          (V1.0.4)
+  *           6. Add the MSCAN register map structure,so XGATE can serve all
+  *              channels through one code path.                            (V1.0.5)
+  *           7. Set the local transmit priority by the CAN ID when sending
+  *              a frame.                                                   (V1.0.6)
+  *           8. Add the acceptance filter manager,which compiles a list of
+  *              wanted ID ranges into the densest filter mode.            (V1.0.7)
+  *           9. Add the profiling probe of the send function.             (V1.0.8)
+  *          10. Remove the transmitter empty interrupt function,XGATE is
+  *              the only writer of CANxTIER after initialization.         (V1.0.9)
+  *          11. Remove the profiling probe of the send function,the frames
+  *              are loaded by XGATE,which is probed instead.              (V1.1.0)
+  *          12. Remove the old receive function,XGATE decodes the frames
+  *              straight into the receive buffers.                        (V1.1.1)
+  * @version: V1.1.1
   * @date:    26-Sep-2015
 
   ******************************************************************************
@@ -43,10 +58,326 @@
 
 
 
+/* MSCAN register blocks indexed by MSCAN_ChannelTypeDef */
+static volatile MSCAN_RegTypeDef* const MSCAN_Regs[] = MSCAN_REGBASE_TABLE;
+
+
+#define   MSCAN_FILTER_MODE_NUM     (3)            /* Two 32-bit,four 16-bit and eight 8-bit acceptance filters */
+#define   MSCAN_FILTER_BLOCK_MAX    (16)           /* Number of blocks the filter compiler works on */
+
+#define   MSCAN_IDR_STD_BITS        (0xFFF00000u)  /* ID and RTR bits of a standard ID in the image */
+#define   MSCAN_IDR_EXT_BITS        (0xFFE7FFFFu)  /* ID and RTR bits of an extended ID in the image */
+
+
+/* 
+   One block of the filter compiler.A frame passes the block when its identifier register image
+   equals code in every bit which is cleared in mask,the same as the MSCAN filter compare.
+*/
+typedef struct
+{
+    uint32_t code;
+    uint32_t mask;
+}MSCAN_FilterBlockTypeDef;
+
+
+/* Number of filters,IDAM bits and the image bits which are not compared in each filter mode */
+static const uint8_t  MSCAN_FilterSlots[MSCAN_FILTER_MODE_NUM]    = {2, 4, 8};
+static const uint8_t  MSCAN_FilterIDAM[MSCAN_FILTER_MODE_NUM]     = {0x00u, 0x10u, 0x20u};
+static const uint32_t MSCAN_FilterModeMask[MSCAN_FILTER_MODE_NUM] = {0x00000000u, 0x0000FFFFu, 0x00FFFFFFu};
+
+/* Working blocks of the filter compiler,static because they do not fit into the stack */
+static MSCAN_FilterBlockTypeDef MSCAN_FilterBlocks[MSCAN_FILTER_BLOCK_MAX];
+
+
+
+
+/**
+ * @brief   Add two numbers of identifiers,the sum saturates at 0xFFFFFFFF.
+ * @param   a, b, The numbers of identifiers.
+ * @returns The sum.
+ */
+static uint32_t MSCAN_FilterAddNum(uint32_t a, uint32_t b) 
+{
+    return (a + b < a) ? 0xFFFFFFFFu : (a + b);
+}
+
+
+
+/**
+ * @brief   Count the frame identifiers which pass a filter block.
+ * @param   code, mask, The filter block.
+ * @attention A standard frame has 12 ID and RTR bits and an extended frame has 30,the IDE bit 
+ *            decides which of them are counted.The SRR bit of an extended frame is always set.
+ * @returns The number of identifiers.
+ */
+static uint32_t MSCAN_FilterVolume(uint32_t code, uint32_t mask) 
+{
+    uint8_t i,std_bits = 0,ext_bits = 0;
+    
+    uint32_t num = 0;
+    
+    for (i = 0; i < 32; i++) 
+    {
+        if ((mask & MSCAN_IDR_STD_BITS & (1ul << i)) != 0)std_bits++;
+        if ((mask & MSCAN_IDR_EXT_BITS & (1ul << i)) != 0)ext_bits++;
+    }
+    
+    if (((mask & CAN_IDR_IDE) != 0) || ((code & CAN_IDR_IDE) == 0))num += 1ul << std_bits;
+    
+    if (((mask & CAN_IDR_IDE) != 0) || ((code & CAN_IDR_IDE) != 0)) 
+    {
+        /* An extended frame with a cleared SRR bit does not exist. */
+        if (((mask & CAN_IDR_SRR) != 0) || ((code & CAN_IDR_SRR) != 0))num += 1ul << ext_bits;
+    }
+    
+    return num;
+}
+
+
+
+/**
+ * @brief   Merge filter blocks until no more than max_num blocks are left.
+ * @param   *num, Number of blocks in MSCAN_FilterBlocks,it is updated.
+ *          max_num, Number of blocks to be left.
+ * @attention Every step merges the two blocks whose common block passes the fewest identifiers 
+ *            which none of them passed before,so the false positives grow as slowly as possible.
+ *            A block inside another block is merged for free.
+ * @returns None
+ */
+static void MSCAN_FilterReduce(uint8_t* num, uint8_t max_num) 
+{
+    uint8_t i,j,best_i,best_j;
+    
+    uint32_t mask,best_mask;
+    
+    int32_t cost,best_cost;
+    
+    while (*num > max_num) 
+    {
+        best_i = 0;
+        best_j = 1;
+        best_mask = 0;
+        best_cost = 0x7FFFFFFFl;
+        
+        for (i = 0; i < *num; i++) 
+        {
+            for (j = i + 1; j < *num; j++) 
+            {
+                mask = MSCAN_FilterBlocks[i].mask | MSCAN_FilterBlocks[j].mask
+                     | (MSCAN_FilterBlocks[i].code ^ MSCAN_FilterBlocks[j].code);
+                
+                cost = (int32_t)MSCAN_FilterVolume(MSCAN_FilterBlocks[i].code & ~mask, mask)
+                     - (int32_t)MSCAN_FilterVolume(MSCAN_FilterBlocks[i].code, MSCAN_FilterBlocks[i].mask)
+                     - (int32_t)MSCAN_FilterVolume(MSCAN_FilterBlocks[j].code, MSCAN_FilterBlocks[j].mask);
+                
+                if (cost < best_cost) 
+                {
+                    best_i = i;
+                    best_j = j;
+                    best_mask = mask;
+                    best_cost = cost;
+                }
+            }
+        }
+        
+        MSCAN_FilterBlocks[best_i].mask  = best_mask;
+        MSCAN_FilterBlocks[best_i].code &= ~best_mask;
+        
+        /* Fill the gap with the last block. */
+        MSCAN_FilterBlocks[best_j] = MSCAN_FilterBlocks[--(*num)];
+    }
+}
+
+
+
+/**
+ * @brief   Split a range of wanted IDs into aligned blocks and add them to the filter blocks.
+ * @param   *range, The range of wanted IDs.
+ *          *num, Number of blocks in MSCAN_FilterBlocks,it is updated.
+ *          mode_mask, Image bits which are not compared in the filter mode.
+ *          *wanted, Number of wanted identifiers,the range is added to it.
+ * @attention Each block covers a power of two IDs starting at a multiple of its size,so it is
+ *            one exact filter.When the working blocks are used up the closest blocks are merged.
+ * @returns 0: Calling succeeded.
+ * 			-1: Calling failed.The range is invalid.
+ */
+static int16_t MSCAN_FilterAddRange(const MSCAN_FilterRangeTypeDef* range, uint8_t* num, uint32_t mode_mask, uint32_t* wanted) 
+{
+    uint32_t id,size,code,mask,rtr_mask;
+    
+    uint8_t rtr,ext;
+    
+    if (range->id_low > range->id_high)return -1;
+    
+    if (range->id_format == OnlyAcceptStandardID) 
+    {
+        if (range->id_high > 0x7FFu)return -1;
+        
+        ext = 0;
+        rtr_mask = CAN_IDR_SRR;
+    } 
+    else if (range->id_format == OnlyAcceptExtendedID) 
+    {
+        if (range->id_high > 0x1FFFFFFFu)return -1;
+        
+        ext = 1;
+        rtr_mask = 0x00000001u;
+    } 
+    else 
+    {
+        return -1;
+    }
+    
+    if (range->frame_type == OnlyAcceptRemoteFrame)rtr = 1;
+    else if ((range->frame_type == OnlyAcceptDataFrame) || (range->frame_type == AcceptBothFrame))rtr = 0;
+    else return -1;
+    
+    size = range->id_high - range->id_low + 1;
+    
+    if (range->frame_type == AcceptBothFrame)size = MSCAN_FilterAddNum(size, size);
+    
+    *wanted = MSCAN_FilterAddNum(*wanted, size);
+    
+    id = range->id_low;
+    
+    for (;;) 
+    {
+        /* Largest aligned block which starts at id and ends inside the range */
+        size = 1;
+        
+        while (((id & ((size << 1) - 1)) == 0) && ((size << 1) - 1 <= range->id_high - id))size <<= 1;
+        
+        if (ext != 0) 
+        {
+            code = CAN_IDR_EXT(id, rtr);
+            mask = CAN_IDR_EXT(size - 1, 0) & ~(CAN_IDR_SRR | CAN_IDR_IDE);
+        } 
+        else 
+        {
+            /* IDR2,IDR3 and the low bits of IDR1 are not part of a standard ID. */
+            code = CAN_IDR_STD(id, rtr);
+            mask = CAN_IDR_STD(size - 1, 0) | 0x0007FFFFu;
+        }
+        
+        if (range->frame_type == AcceptBothFrame)mask |= rtr_mask;
+        
+        mask |= mode_mask;
+        
+        /* Make room for the new block. */
+        if (*num == MSCAN_FILTER_BLOCK_MAX)MSCAN_FilterReduce(num, MSCAN_FILTER_BLOCK_MAX - 1);
+        
+        MSCAN_FilterBlocks[*num].code = code & ~mask;
+        MSCAN_FilterBlocks[*num].mask = mask;
+        (*num)++;
+        
+        if (range->id_high - id == size - 1)break;
+        
+        id += size;
+    }
+    
+    return 0;
+}
+
+
+
+/**
+ * @brief   Compile a list of wanted ID ranges into the acceptance filter register image.
+ * @param   *id_list, The wanted ID ranges.
+ *          id_num, Number of ranges in id_list.
+ *          *image, Store the acceptance filter register image.
+ * @attention Every filter mode is tried.The ranges are split into exact blocks,cut to the bits
+ *            which the mode compares,and merged until they fit the filters of the mode.The mode
+ *            which passes the fewest identifiers is taken,and the wider filters win a tie.
+ *            The identifiers passed by overlapping filters are counted more than once.
+ *            The function is not reentrant and is meant for initialization.
+ * @returns 0: Calling succeeded.
+ * 			-1: Calling failed.The list is empty or a range is invalid.
+ */
+int16_t MSCAN_FilterCompile(const MSCAN_FilterRangeTypeDef* id_list, uint8_t id_num, MSCAN_FilterImageTypeDef* image) 
+{
+    uint8_t mode,i,b,num,width;
+    
+    uint32_t accept,wanted,code,mask;
+    
+    if ((NULL == id_list) || (NULL == image) || (id_num == 0))return -1;
+    
+    for (mode = 0; mode < MSCAN_FILTER_MODE_NUM; mode++) 
+    {
+        num = 0;
+        wanted = 0;
+        
+        for (i = 0; i < id_num; i++) 
+        {
+            if (MSCAN_FilterAddRange(&id_list[i], &num, MSCAN_FilterModeMask[mode], &wanted) != 0)return -1;
+        }
+        
+        MSCAN_FilterReduce(&num, MSCAN_FilterSlots[mode]);
+        
+        accept = 0;
+        
+        for (i = 0; i < num; i++) 
+        {
+            accept = MSCAN_FilterAddNum(accept, MSCAN_FilterVolume(MSCAN_FilterBlocks[i].code, MSCAN_FilterBlocks[i].mask));
+        }
+        
+        if ((mode != 0) && (accept >= image->accept_num))continue;
+        
+        image->IDAC       = MSCAN_FilterIDAM[mode];
+        image->wanted_num = wanted;
+        image->accept_num = accept;
+        
+        /* Each filter compares the upper bytes of the image,the unused filters repeat the first one. */
+        width = 8 / MSCAN_FilterSlots[mode];
+        
+        for (i = 0; i < MSCAN_FilterSlots[mode]; i++) 
+        {
+            code = MSCAN_FilterBlocks[(i < num) ? i : 0].code;
+            mask = MSCAN_FilterBlocks[(i < num) ? i : 0].mask;
+            
+            for (b = 0; b < width; b++) 
+            {
+                image->IDAR[i * width + b] = (uint8_t)(code >> (24 - 8 * b));
+                image->IDMR[i * width + b] = (uint8_t)(mask >> (24 - 8 * b));
+            }
+        }
+    }
+    
+    return 0;
+}
+
+
+
+/**
+ * @brief   Write an acceptance filter register image into a MSCAN module.
+ * @param   ch, The MSCAN channel.
+ *          *image, The acceptance filter register image.
+ * @attention The MSCAN module must be in INIT mode.
+ * @returns None
+ */
+static void MSCAN_WriteFilterImage(MSCAN_ChannelTypeDef ch, MSCAN_FilterImageTypeDef* image) 
+{
+    uint8_t i;
+    
+    volatile MSCAN_RegTypeDef* CANx_Regs = MSCAN_Regs[ch];
+    
+    CANx_Regs->IDAC = image->IDAC;
+    
+    for (i = 0; i < 4; i++) 
+    {
+        CANx_Regs->IDAR0[i] = image->IDAR[i];
+        CANx_Regs->IDMR0[i] = image->IDMR[i];
+        CANx_Regs->IDAR4[i] = image->IDAR[i + 4];
+        CANx_Regs->IDMR4[i] = image->IDMR[i + 4];
+    }
+}
+
+
+
 
 /**
  * @brief   Configure the filters about the MSCAN module when receiving CAN frames.
- * &attention  The CAN module is configured to two 32-bit acceptance filters in default.
+ * &attention  The CAN module is configured to two 32-bit acceptance filters in default.When a list of
+ *             wanted ID ranges is given,the filter mode is chosen by MSCAN_FilterCompile().
  * @param   CANx: The pointer which point to MSCAN module number and pins.
  * 			frame_config: The buffer which point to MSCAN module acceptance parameters when receiving CAN frames.
  * @returns 0: Calling succeeded.
@@ -54,8 +385,22 @@
  */
 static int16_t MSCAN_ConfigIDFilter(MSCAN_ModuleConfig* CANx, MSCAN_FilterConfig* CANFilter_Config)
 {
+    MSCAN_FilterImageTypeDef image;
+    
     if ((CANx != NULL) && (CANFilter_Config != NULL)) 
     {   
+        if ((CANx->ch < MSCAN_Channel0) || (CANx->ch > MSCAN_Channel4))return -1;
+        
+        /* Compile the list of wanted ID ranges into all filters. */
+        if ((CANFilter_Config->Filter_Enable != 0) && (CANFilter_Config->id_num != 0)) 
+        {
+            if (MSCAN_FilterCompile(CANFilter_Config->id_list, CANFilter_Config->id_num, &image) != 0)return -1;
+            
+            MSCAN_WriteFilterImage(CANx->ch, &image);
+            
+            return 0;
+        }
+        
         if (CANx->ch == MSCAN_Channel0) 
         {
             /* Judge whether CAN module filter is enabled or disabled */
@@ -1286,6 +1631,9 @@ int16_t MSCAN_SendFrame(MSCAN_ModuleConfig* CANx, MSCAN_MessageTypeDef* W_Frameb
                 }
             }
             
+            /* The buffer with the smaller local priority value is sent first,so follow the ID priority. */
+            CAN0TXTBPR = CAN0TXIDR0;
+            
             /* Clear the respective bits. */
             CAN0TFLG = CAN0TBSEL;
             
@@ -1407,6 +1755,9 @@ int16_t MSCAN_SendFrame(MSCAN_ModuleConfig* CANx, MSCAN_MessageTypeDef* W_Frameb
                 }
             }
             
+            /* The buffer with the smaller local priority value is sent first,so follow the ID priority. */
+            CAN1TXTBPR = CAN1TXIDR0;
+            
             /* Clear the respective bits. */
             CAN1TFLG = CAN1TBSEL;
             
@@ -1528,6 +1879,9 @@ int16_t MSCAN_SendFrame(MSCAN_ModuleConfig* CANx, MSCAN_MessageTypeDef* W_Frameb
                 }
             }
             
+            /* The buffer with the smaller local priority value is sent first,so follow the ID priority. */
+            CAN4TXTBPR = CAN4TXIDR0;
+            
             /* Clear the respective bits. */
             CAN4TFLG = CAN4TBSEL;
             
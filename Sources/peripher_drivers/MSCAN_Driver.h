@@ -16,7 +16,22 @@
   *           3. Add a functon which is Checking the specified CAN module whether 
   *              have enough hard transmission buffer to send CAN messages. (V1.0.2)
   *           4. Change CAN message structure definetion.                   (V1.0.3)
-  * @version: V1.0.2
+  *           5. Add a function which enables or disables the transmitter
+  *              empty interrupts.                                          (V1.0.4)
+  *           6. Add the MSCAN register map structure,so XGATE can serve all
+  *              channels through one code path.                            (V1.0.5)
+  *           7. Set the local transmit priority by the CAN ID when sending
+  *              a frame.                                                   (V1.0.6)
+  *           8. Add the acceptance filter manager,which compiles a list of
+  *              wanted ID ranges into the densest filter mode.            (V1.0.7)
+  *           9. Add the profiling probe of the send function.             (V1.0.8)
+  *          10. Remove the transmitter empty interrupt function,XGATE is
+  *              the only writer of CANxTIER after initialization.         (V1.0.9)
+  *          11. Remove the profiling probe of the send function,the frames
+  *              are loaded by XGATE,which is probed instead.              (V1.1.0)
+  *          12. Remove the old receive function,XGATE decodes the frames
+  *              straight into the receive buffers.                        (V1.1.1)
+  * @version: V1.1.1
   * @date:    26-Sep-2015
 
   ******************************************************************************
@@ -50,7 +65,7 @@
 /* Exported types ------------------------------------------------------------*/
 
 /* Declaration MSCAN driver version */
-#define   MSCAN_DRIVER_VERSION     (103)		/* Rev1.0.3 */
+#define   MSCAN_DRIVER_VERSION     (111)		/* Rev1.1.1 */
 
 
 
@@ -144,10 +159,77 @@ typedef struct
     uint8_t  data[8];							/* 8 bytes data */
     uint16_t  data_length;						/* CAN frame data length */
     uint32_t frame_id;							/* CAN frame ID value */
+    uint32_t time_stamp;						/* Receive time stamp,microsecond system time */
 }MSCAN_MessageTypeDef;
 
 
 
+/* MSCAN receive and transmit foreground buffer layout */
+typedef struct
+{
+    uint8_t IDR[4];                             /* Identifier registers 0..3 */
+    uint8_t DSR[8];                             /* Data segment registers 0..7 */
+    uint8_t DLR;                                /* Data length register */
+    uint8_t TBPR;                               /* Transmit buffer priority register,reserved in the receive buffer */
+    uint8_t TSRH;                               /* Time stamp register high byte */
+    uint8_t TSRL;                               /* Time stamp register low byte */
+}MSCAN_FrameBufferTypeDef;
+
+
+
+/* 
+   MSCAN module register map.All MSCAN modules have the same register layout,so one code path
+   can serve every module through a pointer to its register block.
+*/
+typedef struct
+{
+    uint8_t CTL0;                               /* Control register 0 */
+    uint8_t CTL1;                               /* Control register 1 */
+    uint8_t BTR0;                               /* Bus timing register 0 */
+    uint8_t BTR1;                               /* Bus timing register 1 */
+    uint8_t RFLG;                               /* Receiver flag register */
+    uint8_t RIER;                               /* Receiver interrupt enable register */
+    uint8_t TFLG;                               /* Transmitter flag register */
+    uint8_t TIER;                               /* Transmitter interrupt enable register */
+    uint8_t TARQ;                               /* Transmitter message abort request register */
+    uint8_t TAAK;                               /* Transmitter message abort acknowledge register */
+    uint8_t TBSEL;                              /* Transmit buffer selection register */
+    uint8_t IDAC;                               /* Identifier acceptance control register */
+    uint8_t Reserved;
+    uint8_t MISC;                               /* Miscellaneous register */
+    uint8_t RXERR;                              /* Receive error counter */
+    uint8_t TXERR;                              /* Transmit error counter */
+    uint8_t IDAR0[4];                           /* Identifier acceptance registers 0..3 */
+    uint8_t IDMR0[4];                           /* Identifier mask registers 0..3 */
+    uint8_t IDAR4[4];                           /* Identifier acceptance registers 4..7 */
+    uint8_t IDMR4[4];                           /* Identifier mask registers 4..7 */
+    MSCAN_FrameBufferTypeDef RXFG;              /* Receive foreground buffer */
+    MSCAN_FrameBufferTypeDef TXFG;              /* Transmit foreground buffer */
+}MSCAN_RegTypeDef;
+
+
+/* 
+   Initializer of a register block table indexed by MSCAN_ChannelTypeDef.CPU core and XGATE
+   each define their own table with it,because the two cores do not share constants.
+*/
+#define   MSCAN_REGBASE_TABLE                                             \
+{                                                                         \
+    (volatile MSCAN_RegTypeDef*)&CAN0CTL0,                                \
+    (volatile MSCAN_RegTypeDef*)&CAN1CTL0,                                \
+    (volatile MSCAN_RegTypeDef*)&CAN4CTL0,                                \
+}
+
+
+
+/* Image of the identifier registers IDR0..IDR3 of a standard and an extended ID,rtr is 1 for a remote frame */
+#define   CAN_IDR_STD(id, rtr)        ((((uint32_t)(id) & 0x7FFu) << 21) | ((rtr) ? 0x00100000u : 0u))
+#define   CAN_IDR_EXT(id, rtr)        ((((uint32_t)(id) << 3) & 0xFFE00000u) | 0x00180000u \
+                                     | (((uint32_t)(id) << 1) & 0x0007FFFEu) | ((rtr) ? 0x00000001u : 0u))
+#define   CAN_IDR_IDE                 (0x00080000u)    /* IDE bit in the image */
+#define   CAN_IDR_SRR                 (0x00100000u)    /* SRR bit of an extended ID,RTR bit of a standard ID */
+
+
+
 /* CAN filters accept ID format enumeration */ 
 typedef enum
 {
@@ -167,6 +249,33 @@ typedef enum
 
 
 
+/* 
+   One range of wanted IDs for the acceptance filter manager.A single ID is a range whose
+   first and last IDs are equal.
+*/
+typedef struct
+{
+    AcceptIDFormat id_format;      /* ID format of the range. */
+    AcceptFrameType frame_type;    /* Accepted frame type of the range. */
+    uint32_t id_low;               /* First ID of the range. */
+    uint32_t id_high;              /* Last ID of the range,it must not be less than id_low. */
+}MSCAN_FilterRangeTypeDef;
+
+
+
+/* Acceptance filter register image,which is built by MSCAN_FilterCompile() */
+typedef struct
+{
+    uint8_t  IDAC;                 /* Identifier acceptance control register,IDAM bits */
+    uint8_t  IDAR[8];              /* Identifier acceptance registers 0..7 */
+    uint8_t  IDMR[8];              /* Identifier mask registers 0..7 */
+    uint32_t wanted_num;           /* Number of identifiers in the range list,saturates at 0xFFFFFFFF. */
+    uint32_t accept_num;           /* Number of identifiers passed by the filters,saturates at 0xFFFFFFFF.
+                                      accept_num - wanted_num is the number of false positives. */
+}MSCAN_FilterImageTypeDef;
+
+
+
 /* CAN filters parameters declaration */
 typedef struct
 {
@@ -178,6 +287,9 @@ typedef struct
                                       if user assign the special received ID value.If user set this variable to 0xFFFFFFFF,it means that
                                       the filter identifier mask register can't work. */    
     uint32_t id_accept;            /* This variable is identifier acceptance received ID value,user can assign it */
+    const MSCAN_FilterRangeTypeDef* id_list;  /* Wanted ID ranges.If id_num is not zero,the ranges are compiled into
+                                                 all filters and the single filter parameters above don't work. */
+    uint8_t id_num;                /* Number of ranges in id_list,zero selects the single filter parameters. */
 }MSCAN_FilterConfig;
 
 
@@ -200,9 +312,8 @@ int16_t MSCAN_SendFrame(MSCAN_ModuleConfig* CANx, MSCAN_MessageTypeDef* W_Frameb
 int16_t MSCAN_HardTxBufferCheck(MSCAN_ChannelTypeDef CANx);
 
 
-/* MSCAN receive a frame by a chosen CAN module. */
-//int16_t MSCAN_ReceiveFrame(MSCAN_ModuleConfig* CANx, MSCAN_MessageTypeDef* R_Framebuff);
-
+/* Compile a list of wanted ID ranges into the acceptance filter register image. */
+int16_t MSCAN_FilterCompile(const MSCAN_FilterRangeTypeDef* id_list, uint8_t id_num, MSCAN_FilterImageTypeDef* image);
 
 
 #ifdef __cplusplus
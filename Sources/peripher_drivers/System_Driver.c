@@ -8,8 +8,15 @@
   *                Actually,the RTI is system tick for users.Users can use it for RTOS and
   *                delay functions.
   * @Others: None
-  * @History: 1. Created by Wangjian.
-  * @version: V1.0.0
+  * @History: 1. Created by Wangjian.                                       (V1.0.0)
+  *           2. Add a tick driven cooperative task scheduler.              (V1.0.1)
+  *           3. Add the microsecond system time.                           (V1.0.2)
+  *           4. Add the profiling probes.                                  (V1.0.3)
+  *           5. Run the periodic tasks with zero delay at once.            (V1.0.4)
+  *           6. Write the timer system control register only once.         (V1.0.5)
+  *           7. Read the probe records by their sequence counters.         (V1.0.6)
+  *           8. Guard the time high word by a sequence counter.            (V1.0.7)
+  * @version: V1.0.7
   * @date:    19-Sep-2015
 
   ******************************************************************************
@@ -37,6 +44,41 @@
 static volatile uint32_t g_TimingDelay = 0;
 
 
+#pragma DATA_SEG SHARED_DATA
+
+/* High word of the microsecond system time,counted by the timer overflow interrupt */
+volatile uint16_t g_SystemTimeHigh;
+
+/* Sequence counter of the high word,odd while the timer overflow is counted */
+volatile uint16_t g_SystemTimeSeq;
+
+#ifdef SYSTEM_PROFILE
+/* Records of the profiling probes,they can also be read by the debugger */
+volatile SystemProfile_TypeDef g_SystemProfile[SYSTEM_PROFILE_NUM];
+#endif
+
+#pragma DATA_SEG DEFAULT
+
+
+/* Bus clock frequency in MHz indexed by BusClockFrequency_TypeDef */
+static const uint8_t SystemBusClock_MHz[] = {16, 20, 32, 40, 48, 60};
+
+
+/* Task control block of the cooperative task scheduler */
+typedef struct
+{
+	SystemTask_Func func;					/* Task function,NULL if the block is free */
+	uint16_t period;						/* Period in RTI ticks,zero for a one-shot task */
+	volatile uint16_t count;				/* Ticks until the task is due,zero if it is not counting */
+	volatile uint8_t ready;					/* The task is due and waits for SystemTask_Run() */
+	uint8_t oneshot;						/* The task is deleted after it has run */
+	uint32_t max_time;						/* Longest run time in microseconds */
+}SystemTask_TypeDef;
+
+
+static SystemTask_TypeDef g_SystemTask[SYSTEM_TASK_NUM];
+
+
   
   
  /**
@@ -240,11 +282,147 @@ void TimeDelay_Decrement(void)
 
 
 
+
+ /**
+ * @brief   Start the microsecond system time.
+ * @param   Bus_Clk, system bus clock frequency set by SystemClock_Init().
+ * @attention The ECT precision prescaler divides the bus clock down to 1MHz,the main timer
+ *            prescaler is not used.The timer keeps running in wait mode,so the time goes on
+ *            while the CPU waits for the tasks.User must add the timer overflow interrupt 
+ *            service routine,which calls SystemTime_Overflow().It must be called only once,
+ *            because the precision prescaler enable bit can only be written once.
+ * @returns 0: Calling succeeded.
+ * 			-1: Calling failed.
+ */
+int16_t SystemTime_Init(BusClockFrequency_TypeDef Bus_Clk)
+{
+	if ((Bus_Clk < BusClock_16MHz) || (Bus_Clk > BusClock_60MHz))return -1;
+	
+	/* One count per microsecond */
+	ECT_PTPSR = SystemBusClock_MHz[Bus_Clk] - 1;
+	
+	g_SystemTimeHigh = 0;
+	g_SystemTimeSeq  = 0;
+	
+	/* Clear the timer overflow flag and enable the timer overflow interrupt */
+	ECT_TFLG2 = 0x80u;
+	ECT_TSCR2 = 0x80u;
+	
+	/* Enable the timer with the precision prescaler,TEN | PRNT.PRNT is write once,so TSCR1 is written only here. */
+	ECT_TSCR1 = 0x88u;
+	
+#ifdef SYSTEM_PROFILE
+	SystemProfile_Reset();
+#endif
+	
+	return 0;
+}
+
+
+
+ /**
+ * @brief   Get the microsecond system time.
+ * @param   None
+ * @attention This function may be called with the interrupts disabled,a pending timer overflow
+ *            is taken into account.
+ * @returns The system time in microseconds.
+ */
+uint32_t SystemTime_Us(void)
+{
+	uint32_t t;
+	
+	SYSTEM_TIME_READ(t);
+	
+	return t;
+}
+
+
+
+ /**
+ * @brief   Count the timer overflow of the microsecond system time.
+ * @param   None
+ * @attention This function must be called by the timer overflow interrupt service routine.
+ *            XGATE may read the time in between,so the flag and the high word are only changed
+ *            while the sequence counter is odd.The time must not be read by an interrupt which 
+ *            may interrupt this function.
+ * @returns None
+ */
+void SystemTime_Overflow(void)
+{
+	g_SystemTimeSeq++;
+	
+	/* Clear the timer overflow flag by writing 1 to it */
+	ECT_TFLG2 = 0x80u;
+	
+	g_SystemTimeHigh++;
+	
+	g_SystemTimeSeq++;
+}
+
+
+
+#ifdef SYSTEM_PROFILE
+ /**
+ * @brief   Clear the records of all profiling probes.
+ * @param   None
+ * @attention XGATE probes which run during the clearing may leave a mixed record.
+ * @returns None
+ */
+void SystemProfile_Reset(void)
+{
+	uint8_t i;
+	
+	for (i = 0; i < SYSTEM_PROFILE_NUM; i++)
+	{
+		g_SystemProfile[i].seq++;
+		g_SystemProfile[i].min   = 0xFFFFu;
+		g_SystemProfile[i].max   = 0;
+		g_SystemProfile[i].total = 0;
+		g_SystemProfile[i].count = 0;
+		g_SystemProfile[i].seq++;
+	}
+}
+
+
+
+ /**
+ * @brief   Get the record of a profiling probe.
+ * @param   id, The probe ID.
+ *          *probe, Store the record,the average time is total / count.
+ * @attention A probe may be updated by an interrupt or by XGATE at any time.The copy is taken 
+ *            again until the sequence counter is even and has not changed during the copy,so
+ *            the interrupt mask is not touched.This function must not be called by an 
+ *            interrupt which may interrupt the exit of the same probe.
+ * @returns 0: Calling succeeded.
+ * 			-1: Calling failed.
+ */
+int16_t SystemProfile_Get(SystemProfileId_TypeDef id, SystemProfile_TypeDef* probe)
+{
+	uint16_t seq;
+	
+	if ((id < Profile_RTI_ISR) || (id >= SYSTEM_PROFILE_NUM))return -1;
+	
+	if (NULL == probe)return -1;
+	
+	do
+	{
+		seq    = g_SystemProfile[id].seq;
+		*probe = g_SystemProfile[id];
+	}while ((seq != g_SystemProfile[id].seq) || ((seq & 1u) != 0));
+	
+	return 0;
+}
+#endif
+
+
+
  /**
  * @brief   Delay functions.
  * @param   Cycle: User specified over flow cycle time value.
  * @attention If user wants to use the following three delay functions,user
  *            must add RTI_ISR function to your project!
+ *            These functions spin until the delay is over,tasks should be
+ *            delayed by the task scheduler instead.
  * @returns None
  */
 #ifdef _1MS_PERTICKS
@@ -274,5 +452,196 @@ void Delay100ms(volatile uint32_t nTime)
 }
 #endif
 
+
+
+ /**
+ * @brief   Create a task of the cooperative task scheduler.
+ * @param   func, Task function.
+ *          delay, RTI ticks until the first run,zero to run a periodic task at once.
+ *          period, RTI ticks between the runs,zero for a one-shot task.
+ * @attention A one-shot task is deleted after it has run.A task with zero delay and zero period
+ *            is an event task,it only runs when SystemTask_Trigger() is called and is kept.
+ *            A periodic task which is not finished when it is due again runs once for all the
+ *            missed periods.
+ * @returns >= 0: Calling succeeded,the task ID.
+ * 			-1: Calling failed.There is no free task or the function is NULL.
+ */
+int16_t SystemTask_Create(SystemTask_Func func, uint16_t delay, uint16_t period)
+{
+	int16_t i;
+	
+	if (NULL == func)return -1;
+	
+	for (i = 0; i < SYSTEM_TASK_NUM; i++)
+	{
+		if (g_SystemTask[i].func != NULL)continue;
+		
+		g_SystemTask[i].period   = period;
+		
+		/* A zero count stops the counting,so a periodic task with zero delay is due at once. */
+		if ((0 == delay) && (period != 0))
+		{
+			g_SystemTask[i].count = period;
+			g_SystemTask[i].ready = 1;
+		}
+		else
+		{
+			g_SystemTask[i].count = delay;
+			g_SystemTask[i].ready = 0;
+		}
+		
+		g_SystemTask[i].oneshot  = ((0 == period) && (delay != 0)) ? 1 : 0;
+		g_SystemTask[i].max_time = 0;
+		
+		/* The task becomes visible to SystemTask_Tick() with its function. */
+		g_SystemTask[i].func     = func;
+		
+		return i;
+	}
+	
+	return -1;
+}
+
+
+
+ /**
+ * @brief   Delete a task of the cooperative task scheduler.
+ * @param   task_id, The task ID returned by SystemTask_Create().
+ * @returns 0: Calling succeeded.
+ * 			-1: Calling failed.
+ */
+int16_t SystemTask_Delete(int16_t task_id)
+{
+	if ((task_id < 0) || (task_id >= SYSTEM_TASK_NUM))return -1;
+	
+	g_SystemTask[task_id].func  = NULL;
+	g_SystemTask[task_id].ready = 0;
+	
+	return 0;
+}
+
+
+
+ /**
+ * @brief   Make a task ready to run at once.
+ * @param   task_id, The task ID returned by SystemTask_Create().
+ * @attention This function may be called by interrupt service routines to run a task as soon
+ *            as its data arrives.Several triggers before the task runs cause a single run.
+ * @returns 0: Calling succeeded.
+ * 			-1: Calling failed.
+ */
+int16_t SystemTask_Trigger(int16_t task_id)
+{
+	if ((task_id < 0) || (task_id >= SYSTEM_TASK_NUM))return -1;
+	
+	if (NULL == g_SystemTask[task_id].func)return -1;
+	
+	g_SystemTask[task_id].ready = 1;
+	
+	return 0;
+}
+
+
+
+ /**
+ * @brief   Get the longest run time of a task.
+ * @param   task_id, The task ID returned by SystemTask_Create().
+ *          *max_time, Store the longest run time in microseconds since the task was created.
+ * @returns 0: Calling succeeded.
+ * 			-1: Calling failed.
+ */
+int16_t SystemTask_GetMaxTime(int16_t task_id, uint32_t* max_time)
+{
+	if ((task_id < 0) || (task_id >= SYSTEM_TASK_NUM))return -1;
+	
+	if (NULL == max_time)return -1;
+	
+	*max_time = g_SystemTask[task_id].max_time;
+	
+	return 0;
+}
+
+
+
+ /**
+ * @brief   Count the RTI tick of all tasks and mark the tasks which are due.
+ * @param   None
+ * @attention This function must be called by RTI_ISR.
+ * @returns None
+ */
+void SystemTask_Tick(void)
+{
+	uint8_t i;
+	
+	for (i = 0; i < SYSTEM_TASK_NUM; i++)
+	{
+		if ((NULL == g_SystemTask[i].func) || (0 == g_SystemTask[i].count))continue;
+		
+		if (--g_SystemTask[i].count == 0)
+		{
+			g_SystemTask[i].count = g_SystemTask[i].period;
+			g_SystemTask[i].ready = 1;
+		}
+	}
+}
+
+
+
+ /**
+ * @brief   Run the ready tasks for ever.
+ * @param   None
+ * @attention This function never returns.It runs the ready task with the smallest ID and then
+ *            starts to search from the first task again.If no task is ready,the CPU waits in 
+ *            WAI until the next interrupt.The interrupts are enabled by this function.
+ * @returns None
+ */
+void SystemTask_Run(void)
+{
+	uint8_t i;
+	
+	uint32_t start,time;
+	
+	SystemTask_Func func;
+	
+	for (;;)
+	{
+		DisableInterrupts;
+		
+		for (i = 0; i < SYSTEM_TASK_NUM; i++)
+		{
+			if ((g_SystemTask[i].func != NULL) && (g_SystemTask[i].ready != 0))break;
+		}
+		
+		if (i == SYSTEM_TASK_NUM)
+		{
+			/* An interrupt is not taken between CLI and WAI,so a task made ready after the 
+			   search always wakes the CPU up. */
+			EnableInterrupts;
+			
+			_asm(wai);
+			
+			continue;
+		}
+		
+		func = g_SystemTask[i].func;
+		
+		g_SystemTask[i].ready = 0;
+		
+		/* A one-shot task is deleted before it runs,so it may create itself again. */
+		if (g_SystemTask[i].oneshot != 0)g_SystemTask[i].func = NULL;
+		
+		EnableInterrupts;
+		
+		start = SystemTime_Us();
+		
+		func();
+		
+		time = SystemTime_Us() - start;
+		
+		/* The task may have been deleted or replaced while it ran. */
+		if ((g_SystemTask[i].func == func) && (time > g_SystemTask[i].max_time))g_SystemTask[i].max_time = time;
+	}
+}
+
 /*****************************END OF FILE**************************************/
   
\ No newline at end of file
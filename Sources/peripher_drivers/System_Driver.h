@@ -8,8 +8,15 @@
   *                Actually,the RTI is system tick for users.Users can use it for RTOS and
   *                delay functions.
   * @Others: None
-  * @History: 1. Created by Wangjian.
-  * @version: V1.0.0
+  * @History: 1. Created by Wangjian.                                       (V1.0.0)
+  *           2. Add a tick driven cooperative task scheduler.              (V1.0.1)
+  *           3. Add the microsecond system time.                           (V1.0.2)
+  *           4. Add the profiling probes.                                  (V1.0.3)
+  *           5. Run the periodic tasks with zero delay at once.            (V1.0.4)
+  *           6. Write the timer system control register only once.         (V1.0.5)
+  *           7. Read the probe records by their sequence counters.         (V1.0.6)
+  *           8. Guard the time high word by a sequence counter.            (V1.0.7)
+  * @version: V1.0.7
   * @date:    19-Sep-2015
 
   ******************************************************************************
@@ -45,7 +52,7 @@
 /* Exported types ------------------------------------------------------------*/
 
 /* Declaration System clock driver version */
-#define   SYSTEM_DRIVER_VERSION     (100)		/* Rev1.0.0 */
+#define   SYSTEM_DRIVER_VERSION     (107)		/* Rev1.0.7 */
 
 
 /* Time ticks macro which can chose different delay function */
@@ -82,6 +89,107 @@ typedef enum
 
 
 
+/* 
+   Cooperative task scheduler.Every task runs to completion in SystemTask_Run(),the RTI tick only
+   marks the tasks which are due.A task with a smaller ID runs first when several tasks are ready.
+*/
+#define   SYSTEM_TASK_NUM           (8)			/* Maximum number of tasks */
+
+/* Task function,it must return instead of waiting */
+typedef void (*SystemTask_Func)(void);
+
+
+
+/* 
+   Microsecond system time.The ECT free running counter counts microseconds and is the low word,the
+   timer overflow interrupt counts the high word g_SystemTimeHigh.The time wraps after 71 minutes,so
+   the time between two readings is their difference modulo 2^32.
+   SYSTEM_TIME_READ() is shared by CPU core and XGATE.The overflow interrupt clears the overflow flag
+   and counts the high word with the sequence counter g_SystemTimeSeq odd,so XGATE can not take the 
+   cleared flag with the old high word.The time is read again until the sequence counter is even and 
+   has not changed around the counter,and a pending overflow which is not yet counted is added when 
+   the counter has already wrapped.
+*/
+#define   SYSTEM_TIME_READ(t)                                                 \
+	do                                                                        \
+	{                                                                         \
+		uint16_t time_seq_,time_high_,time_low_;                              \
+		uint8_t  time_tof_;                                                   \
+		do                                                                    \
+		{                                                                     \
+			time_seq_  = g_SystemTimeSeq;                                     \
+			time_high_ = g_SystemTimeHigh;                                    \
+			time_low_  = ECT_TCNT;                                            \
+			time_tof_  = ECT_TFLG2 & 0x80u;                                   \
+		}while ((time_seq_ != g_SystemTimeSeq) || ((time_seq_ & 1u) != 0));   \
+		if ((time_tof_ != 0) && (time_low_ < 0x8000u))time_high_++;           \
+		(t) = ((uint32_t)time_high_ << 16) | time_low_;                       \
+	}while (0)
+
+
+
+/* 
+   Define SYSTEM_PROFILE to enable the profiling probes.A probe reads the ECT counter once when the 
+   code is entered and once when it is left,and records the minimum,maximum and total time in 
+   microseconds into its entry of g_SystemProfile,which CPU core and XGATE share.The time between 
+   entry and exit must be less than 65536us,and a probe must not be entered again before it is left.
+   Without SYSTEM_PROFILE the probes are empty and the table does not exist.
+*/
+/* #define   SYSTEM_PROFILE */
+
+
+/* Probe IDs */
+typedef enum
+{
+	Profile_RTI_ISR = 0,					/* RTI_ISR */
+	Profile_XGATE_LoadTxBuffer,				/* XGATE MSCAN_LoadTxBuffer(),which loads the frames for sending */
+	Profile_XGATE_Receive,					/* XGATE MSCAN receive handlers */
+	Profile_XGATE_Transmit,					/* XGATE MSCAN transmit routine */
+	Profile_ReceiveEvent,					/* CAN_ReceiveEvent_Handler() */
+	SYSTEM_PROFILE_NUM,
+}SystemProfileId_TypeDef;
+
+
+/* Record of one probe */
+typedef struct
+{
+	uint16_t start;							/* ECT counter at the entry */
+	uint16_t min;							/* Shortest time */
+	uint16_t max;							/* Longest time */
+	uint16_t seq;							/* Sequence counter,odd while the record is updated */
+	uint32_t total;							/* Sum of the times */
+	uint32_t count;							/* Number of exits */
+}SystemProfile_TypeDef;
+
+
+#ifdef SYSTEM_PROFILE
+
+#define   SYSTEM_PROFILE_ENTER(id)   (g_SystemProfile[id].start = ECT_TCNT)
+
+#define   SYSTEM_PROFILE_EXIT(id)                                             \
+	do                                                                        \
+	{                                                                         \
+		uint16_t profile_time_ = ECT_TCNT - g_SystemProfile[id].start;        \
+		g_SystemProfile[id].seq++;                                            \
+		if (profile_time_ < g_SystemProfile[id].min)                          \
+			g_SystemProfile[id].min = profile_time_;                          \
+		if (profile_time_ > g_SystemProfile[id].max)                          \
+			g_SystemProfile[id].max = profile_time_;                          \
+		g_SystemProfile[id].total += profile_time_;                           \
+		g_SystemProfile[id].count++;                                          \
+		g_SystemProfile[id].seq++;                                            \
+	}while (0)
+
+#else
+
+#define   SYSTEM_PROFILE_ENTER(id)
+
+#define   SYSTEM_PROFILE_EXIT(id)
+
+#endif
+
+
+
 /* RTI timer over flow cycle enumeration */
 typedef enum
 {
@@ -92,6 +200,19 @@ typedef enum
 
 
 
+#pragma DATA_SEG SHARED_DATA
+
+extern volatile uint16_t g_SystemTimeHigh;
+extern volatile uint16_t g_SystemTimeSeq;
+
+#ifdef SYSTEM_PROFILE
+extern volatile SystemProfile_TypeDef g_SystemProfile[SYSTEM_PROFILE_NUM];
+#endif
+
+#pragma DATA_SEG DEFAULT
+
+
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -112,6 +233,23 @@ int16_t SystemRTI_Init(RTIOverFlowCycle_TypeDef Cycle);
 void TimeDelay_Decrement(void);
 
 
+int16_t SystemTime_Init(BusClockFrequency_TypeDef Bus_Clk);
+
+
+uint32_t SystemTime_Us(void);
+
+
+void SystemTime_Overflow(void);
+
+
+#ifdef SYSTEM_PROFILE
+void SystemProfile_Reset(void);
+
+
+int16_t SystemProfile_Get(SystemProfileId_TypeDef id, SystemProfile_TypeDef* probe);
+#endif
+
+
 void Delay1ms(volatile uint32_t nTime);
 
 void Delay10ms(volatile uint32_t nTime);
@@ -119,6 +257,24 @@ void Delay10ms(volatile uint32_t nTime);
 void Delay100ms(volatile uint32_t nTime);
 
 
+int16_t SystemTask_Create(SystemTask_Func func, uint16_t delay, uint16_t period);
+
+
+int16_t SystemTask_Delete(int16_t task_id);
+
+
+int16_t SystemTask_Trigger(int16_t task_id);
+
+
+int16_t SystemTask_GetMaxTime(int16_t task_id, uint32_t* max_time);
+
+
+void SystemTask_Tick(void);
+
+
+void SystemTask_Run(void);
+
+
 
 #ifdef __cplusplus
 }
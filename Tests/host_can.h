@@ -0,0 +1,69 @@
+/*
+   The CAN code under test.Each test includes this file once,so it reaches the static functions
+   and tables of CAN_Message.c and xgate.cxgate the way the code in those files does.
+*/
+#ifndef __HOST_CAN_H
+#define __HOST_CAN_H
+
+#include <stdio.h>
+#include <string.h>
+
+#include "host_xgate.h"
+#include "../Sources/CAN_Message.c"
+#include "../Sources/xgate.cxgate"
+#include "host_xgate_end.h"
+
+
+static int test_failures = 0;
+
+#define  TEST_CHECK(cond)                                                         \
+    do                                                                            \
+    {                                                                             \
+        if (!(cond))                                                              \
+        {                                                                         \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);      \
+            test_failures++;                                                      \
+        }                                                                         \
+    }while (0)
+
+/* Exit code of a test */
+#define  TEST_RESULT(name)                                                        \
+    (printf("%s: %s\n", (name), (test_failures == 0) ? "passed" : "FAILED"),      \
+     (test_failures == 0) ? 0 : 1)
+
+
+/* Register block of a channel */
+static __attribute__((unused)) volatile MSCAN_RegTypeDef* host_regs(MSCAN_ChannelTypeDef ch)
+{
+    return (volatile MSCAN_RegTypeDef*)&host_MSCAN_Regs[ch * HOST_MSCAN_BLOCK];
+}
+
+
+/* Put a frame into the receive foreground buffer of a channel the way the MSCAN decodes it */
+static __attribute__((unused)) void host_rxfg_load(MSCAN_ChannelTypeDef ch, uint8_t ext, uint8_t rtr, uint32_t id, uint8_t dlc, const uint8_t* data)
+{
+    uint8_t i;
+    
+    volatile MSCAN_RegTypeDef* regs = host_regs(ch);
+    
+    if (ext != 0)
+    {
+        regs->RXFG.IDR[0] = (uint8_t)(id >> 21);
+        regs->RXFG.IDR[1] = (uint8_t)(((id >> 13) & 0xE0u) | 0x18u | ((id >> 15) & 0x07u));
+        regs->RXFG.IDR[2] = (uint8_t)(id >> 7);
+        regs->RXFG.IDR[3] = (uint8_t)((id << 1) | (rtr ? 0x01u : 0x00u));
+    }
+    else
+    {
+        regs->RXFG.IDR[0] = (uint8_t)(id >> 3);
+        regs->RXFG.IDR[1] = (uint8_t)((id << 5) | (rtr ? 0x10u : 0x00u));
+        regs->RXFG.IDR[2] = 0;
+        regs->RXFG.IDR[3] = 0;
+    }
+    
+    regs->RXFG.DLR = dlc;
+    
+    for (i = 0; i < 8; i++)regs->RXFG.DSR[i] = (data != NULL) ? data[i] : 0;
+}
+
+#endif
@@ -0,0 +1,35 @@
+/*
+   Registers and shared objects which the target gets from the derivative,the linker and main.c.
+*/
+#include "MC9S12XEQ512.h"
+#include "CAN_Message.h"
+#include "System_Driver.h"
+
+volatile uint16_t XGSEM;
+volatile uint16_t XGSWT;
+volatile uint16_t XGIF2;
+volatile uint16_t XGIF3;
+
+volatile uint16_t ECT_TCNT;
+volatile uint8_t  ECT_TFLG2;
+volatile uint8_t  ECT_PTPSR;
+volatile uint8_t  ECT_TSCR1;
+volatile uint8_t  ECT_TSCR2;
+
+volatile uint8_t host_MSCAN_Regs[HOST_PAGE_SIZE] __attribute__((aligned(HOST_PAGE_SIZE)));
+
+volatile uint16_t g_SystemTimeHigh;
+volatile uint16_t g_SystemTimeSeq;
+
+/* Defined by main.c on the target */
+volatile int shared_counter;
+volatile CANReceiveMessageBuffer_TypeDef g_CANx_RecBuffer;
+
+
+/* The receive events wake no tasks on the host */
+int16_t SystemTask_Trigger(int16_t task_id)
+{
+    (void)task_id;
+    
+    return 0;
+}
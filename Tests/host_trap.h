@@ -0,0 +1,151 @@
+/*
+   Store trap of the host tests,x86-64 Linux only.The pages of a watched object are write
+   protected,a store into them faults,the faulting instruction is executed once more by single
+   stepping,and the callback runs right after the store with the pages writable again.
+
+   A test uses it to let the other core run after every single store of the code under test,
+   which covers every interleaving of the two sides of a ring even on a host with one CPU,and
+   to give a register the write-one-to-clear behaviour of the MSCAN flags.
+*/
+#ifndef __HOST_TRAP_H
+#define __HOST_TRAP_H
+
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+
+
+#define  HOST_TRAP_TF        (0x100)                /* Trap flag of RFLAGS */
+
+/* Called after a store into the watched object with the address of the store */
+typedef void (*HostTrap_Callback)(volatile void* addr);
+
+
+/*
+   State of the trap.It fills a page of its own,so it is never write protected together with
+   the watched object.
+*/
+static volatile struct
+{
+    uintptr_t page_low;                              /* First protected page */
+    uintptr_t page_high;                             /* End of the protected pages */
+    uintptr_t obj_low;                               /* Watched object */
+    uintptr_t obj_high;
+    volatile void* addr;                             /* Address of the pending store */
+    HostTrap_Callback callback;
+    unsigned long count;                             /* Number of stores into the watched object */
+    int busy;                                        /* The callback is running */
+}host_trap __attribute__((aligned(HOST_PAGE_SIZE)));
+
+typedef char host_trap_size_check[(sizeof(host_trap) <= HOST_PAGE_SIZE) ? 1 : -1];
+
+
+
+static void host_trap_protect(int prot)
+{
+    mprotect((void*)host_trap.page_low, host_trap.page_high - host_trap.page_low, prot);
+}
+
+
+
+static void host_trap_segv(int sig, siginfo_t* si, void* context)
+{
+    ucontext_t* uc = (ucontext_t*)context;
+
+    uintptr_t addr = (uintptr_t)si->si_addr;
+
+    if ((addr < host_trap.page_low) || (addr >= host_trap.page_high))
+    {
+        /* A real fault,crash with the default action. */
+        signal(sig, SIG_DFL);
+        return;
+    }
+
+    host_trap.addr = si->si_addr;
+
+    host_trap_protect(PROT_READ | PROT_WRITE);
+
+    uc->uc_mcontext.gregs[REG_EFL] |= HOST_TRAP_TF;
+}
+
+
+
+static void host_trap_step(int sig, siginfo_t* si, void* context)
+{
+    ucontext_t* uc = (ucontext_t*)context;
+
+    uintptr_t addr = (uintptr_t)host_trap.addr;
+
+    (void)sig;
+    (void)si;
+
+    uc->uc_mcontext.gregs[REG_EFL] &= ~(greg_t)HOST_TRAP_TF;
+
+    /* Stores into the neighbours of the object on the same pages are only passed through. */
+    if ((addr >= host_trap.obj_low) && (addr < host_trap.obj_high) && (host_trap.busy == 0))
+    {
+        host_trap.count++;
+        host_trap.busy = 1;
+
+        host_trap.callback(host_trap.addr);
+
+        host_trap.busy = 0;
+    }
+
+    if (host_trap.callback != NULL)host_trap_protect(PROT_READ);
+}
+
+
+
+/* Call callback after every store into the object at obj with size bytes until host_trap_stop() */
+static __attribute__((unused)) void host_trap_start(volatile void* obj, size_t size, HostTrap_Callback callback)
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+
+    sa.sa_sigaction = host_trap_segv;
+    sigaction(SIGSEGV, &sa, NULL);
+
+    sa.sa_sigaction = host_trap_step;
+    sigaction(SIGTRAP, &sa, NULL);
+
+    host_trap.obj_low   = (uintptr_t)obj;
+    host_trap.obj_high  = (uintptr_t)obj + size;
+    host_trap.page_low  = host_trap.obj_low & ~(uintptr_t)(HOST_PAGE_SIZE - 1);
+    host_trap.page_high = (host_trap.obj_high + HOST_PAGE_SIZE - 1) & ~(uintptr_t)(HOST_PAGE_SIZE - 1);
+    host_trap.callback  = callback;
+    host_trap.count     = 0;
+    host_trap.busy      = 0;
+
+    host_trap_protect(PROT_READ);
+}
+
+
+
+/* Run fn on the side of the code under test,its stores call no callback */
+static __attribute__((unused)) void host_trap_run(void (*fn)(void))
+{
+    host_trap.busy = 1;
+
+    fn();
+
+    host_trap.busy = 0;
+}
+
+
+
+/* Stop the trap,returns the number of stores into the watched object */
+static __attribute__((unused)) unsigned long host_trap_stop(void)
+{
+    host_trap.callback = NULL;
+
+    host_trap_protect(PROT_READ | PROT_WRITE);
+
+    return host_trap.count;
+}
+
+#endif
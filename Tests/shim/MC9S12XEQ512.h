@@ -0,0 +1,34 @@
+/*
+   Host stand-in of the CodeWarrior derivative header.The registers used by the CAN code are plain
+   variables defined in host_regs.c,which the tests set and check.
+*/
+#ifndef __MC9S12XEQ512_HOST_H
+#define __MC9S12XEQ512_HOST_H
+
+#include "host.h"
+
+extern volatile uint16_t XGSEM;
+extern volatile uint16_t XGSWT;
+extern volatile uint16_t XGIF2;
+extern volatile uint16_t XGIF3;
+
+extern volatile uint16_t ECT_TCNT;
+extern volatile uint8_t  ECT_TFLG2;
+extern volatile uint8_t  ECT_PTPSR;
+extern volatile uint8_t  ECT_TSCR1;
+extern volatile uint8_t  ECT_TSCR2;
+
+/* 
+   Register blocks of MSCAN0,MSCAN1 and MSCAN4,0x40 bytes each.They fill a page of their own,so a 
+   test can write protect them to model the write-one-to-clear flags.
+*/
+#define  HOST_MSCAN_BLOCK     (0x40)
+#define  HOST_PAGE_SIZE       (4096)
+
+extern volatile uint8_t host_MSCAN_Regs[HOST_PAGE_SIZE];
+
+#define  CAN0CTL0             host_MSCAN_Regs[0 * HOST_MSCAN_BLOCK]
+#define  CAN1CTL0             host_MSCAN_Regs[1 * HOST_MSCAN_BLOCK]
+#define  CAN4CTL0             host_MSCAN_Regs[2 * HOST_MSCAN_BLOCK]
+
+#endif
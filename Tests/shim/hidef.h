@@ -0,0 +1,8 @@
+/* Host stand-in of the CodeWarrior hidef.h,the tests run without interrupts */
+#ifndef __HIDEF_HOST_H
+#define __HIDEF_HOST_H
+
+#define  EnableInterrupts
+#define  DisableInterrupts
+
+#endif
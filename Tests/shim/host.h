@@ -0,0 +1,18 @@
+/*
+   Host build of the CAN code for the tests.The Makefile forces this file in front of every source
+   file.It replaces common.h,whose integer types are sized for the HCS12X compiler,and stands in 
+   for the CodeWarrior keywords.
+*/
+#ifndef __HOST_H
+#define __HOST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Keep Sources/common.h out,its uint16_t is an unsigned int,which has 32 bits on the host */
+#define  __COMMON_H
+
+#define  _NEAR
+#define  interrupt
+
+#endif
@@ -0,0 +1,23 @@
+/*
+   Host build of CAN_Message.c and xgate.cxgate.host_can.h includes this file right before the 
+   sources and host_xgate_end.h right after them.
+*/
+#ifndef __HOST_XGATE_H
+#define __HOST_XGATE_H
+
+/* XGATE intrinsics.The host runs the XGATE code alone,so the semaphores are always free. */
+#define  _ssem(n)             (1)
+#define  _csem(n)             ((void)0)
+
+#define  asm
+#define  BRK
+
+#endif
+
+/* The XGATE vector table keeps a data pointer in an int,which has 16 bits on the target */
+#define  int                  intptr_t
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-function"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
@@ -0,0 +1,4 @@
+/* End of the host build of the sources,see host_xgate.h */
+#pragma GCC diagnostic pop
+
+#undef   int
@@ -0,0 +1,299 @@
+/*
+   Receive handler entries under burst load.The MSCAN receive FIFO is modelled with the store trap
+   of host_trap.h:a store into RFLG clears the flags written with 1,and a cleared RXF shifts the
+   next frame of the FIFO into the RxFG.Frames also arrive while the handler runs,so the real
+   MSCAN1Receive_Handler drains bursts the way it does on the bus,and its entry and frame counters
+   are compared with the entries and frames seen by the model.
+*/
+#include "host_can.h"
+#include "host_trap.h"
+
+
+#define  CHANNEL            MSCAN_Channel1
+#define  ID_BASE            (0x18FE0000u)          /* The low 16 bits carry the sequence number */
+#define  STEPS              (10000u)
+
+/* Receive FIFO of the MSCAN,the frame at the head is in the RxFG */
+static volatile struct
+{
+    uint32_t seq[MSCAN_RXFIFO_DEPTH];
+    uint8_t  head;
+    uint8_t  num;
+}fifo;
+
+static volatile uint32_t bus_seq;                  /* Next frame on the bus */
+static volatile uint32_t overrun;                  /* Frames lost because the FIFO was full */
+static volatile uint32_t taken;                    /* Frames released from the RxFG */
+static volatile uint8_t  arrive_pct;               /* Chance of a new frame per released frame */
+
+static uint32_t lcg = 1;
+static uint32_t expected;
+
+
+
+static uint32_t random_u32(void)
+{
+    lcg = lcg * 1103515245u + 12345u;
+
+    return lcg >> 8;
+}
+
+
+
+/* Show the frame at the head of the FIFO in the RxFG */
+static void fifo_load(void)
+{
+    uint8_t i,data[8];
+    uint32_t seq = fifo.seq[fifo.head];
+
+    for (i = 0; i < 8; i++)data[i] = (uint8_t)(seq + i);
+
+    host_rxfg_load(CHANNEL, 1, 0, ID_BASE | (seq & 0xFFFFu), 8, data);
+}
+
+
+
+/* A frame arrives from the bus */
+static void bus_frame(void)
+{
+    if (fifo.num == MSCAN_RXFIFO_DEPTH)
+    {
+        overrun++;
+    }
+    else
+    {
+        fifo.seq[(fifo.head + fifo.num) % MSCAN_RXFIFO_DEPTH] = bus_seq;
+
+        if (fifo.num++ == 0)
+        {
+            fifo_load();
+
+            host_regs(CHANNEL)->RFLG = 0x01u;
+        }
+    }
+
+    bus_seq++;
+}
+
+
+
+/* A store into RFLG,the RXF bit is cleared by writing 1 */
+static void rflg_store(volatile void* addr)
+{
+    uint8_t written = *(volatile uint8_t*)addr;
+
+    if (((written & 0x01u) != 0) && (fifo.num != 0))
+    {
+        taken++;
+
+        fifo.head = (fifo.head + 1) % MSCAN_RXFIFO_DEPTH;
+        fifo.num--;
+
+        if (fifo.num != 0)fifo_load();
+    }
+
+    host_regs(CHANNEL)->RFLG = (fifo.num != 0) ? 0x01u : 0x00u;
+
+    /* The bus goes on while XGATE handles the frame. */
+    if ((random_u32() % 100u) < arrive_pct)bus_frame();
+}
+
+
+
+/* CPU core:read the receive buffer,the frames keep their order and only the overrun ones are missing */
+static uint32_t drain(void)
+{
+    MSCAN_MessageTypeDef msg;
+
+    uint32_t n = 0,seq;
+
+    while (Check_CANReceiveBuffer(CHANNEL, &msg) == 0)
+    {
+        seq = expected + ((msg.frame_id - expected) & 0xFFFFu);
+
+        TEST_CHECK(msg.data[7] == (uint8_t)(seq + 7));
+        TEST_CHECK(seq >= expected);
+
+        expected = seq + 1;
+        n++;
+    }
+
+    return n;
+}
+
+
+
+static void model_start(uint8_t pct)
+{
+    CAN_MessageBuffer_Init();
+
+    fifo.head  = 0;
+    fifo.num   = 0;
+    bus_seq    = 0;
+    overrun    = 0;
+    taken      = 0;
+    arrive_pct = pct;
+    expected   = 0;
+
+    host_regs(CHANNEL)->RFLG = 0x00u;
+
+    host_trap_start(&host_regs(CHANNEL)->RFLG, 1, rflg_store);
+}
+
+
+
+/* Call the handler,returns the number of frames it took */
+static uint32_t handler_entry(void)
+{
+    uint32_t before = taken;
+
+    MSCAN1Receive_Handler();
+
+    return taken - before;
+}
+
+
+
+/* Frames waiting in the FIFO are taken in one entry,up to the FIFO depth */
+static void fifo_test(void)
+{
+    CANReceiveStatistic_TypeDef stat;
+
+    uint8_t k,i;
+
+    for (k = 1; k <= MSCAN_RXFIFO_DEPTH + 2; k++)
+    {
+        model_start(0);
+
+        for (i = 0; i < k; i++)host_trap_run(bus_frame);
+
+        TEST_CHECK(handler_entry() == ((k < MSCAN_RXFIFO_DEPTH) ? k : MSCAN_RXFIFO_DEPTH));
+        TEST_CHECK((host_regs(CHANNEL)->RFLG & 0x01u) == 0);
+
+        /* An entry without a frame is not counted. */
+        TEST_CHECK(handler_entry() == 0);
+
+        (void)host_trap_stop();
+
+        CAN_GetReceiveStatistic(CHANNEL, &stat);
+
+        TEST_CHECK(stat.entry_count == 1);
+        TEST_CHECK(stat.frame_count == taken);
+        TEST_CHECK(stat.burst_max == taken);
+        TEST_CHECK(overrun == ((k > MSCAN_RXFIFO_DEPTH) ? (k - MSCAN_RXFIFO_DEPTH) : 0u));
+        TEST_CHECK(drain() == taken);
+    }
+
+    /* A frame arrives for every frame taken,the entry stops at the FIFO depth and RXF stays set. */
+    model_start(100);
+
+    host_trap_run(bus_frame);
+
+    TEST_CHECK(handler_entry() == MSCAN_RXFIFO_DEPTH);
+    TEST_CHECK((host_regs(CHANNEL)->RFLG & 0x01u) != 0);
+
+    (void)host_trap_stop();
+}
+
+
+
+/* The counters stop together before the frame counter wraps */
+static void saturation_test(void)
+{
+    CANReceiveStatistic_TypeDef stat;
+
+    uint8_t i;
+
+    model_start(0);
+
+    g_CANx_RecBuffer.stat[CHANNEL].entry_count = 1000;
+    g_CANx_RecBuffer.stat[CHANNEL].frame_count = 0xFFFEu;
+
+    for (i = 0; i < 3; i++)host_trap_run(bus_frame);
+
+    TEST_CHECK(handler_entry() == 3);
+
+    (void)host_trap_stop();
+
+    CAN_GetReceiveStatistic(CHANNEL, &stat);
+
+    TEST_CHECK(stat.entry_count == 1000);
+    TEST_CHECK(stat.frame_count == 0xFFFEu);
+    TEST_CHECK(stat.burst_max == 3);
+}
+
+
+
+/* Random bursts,the handler is entered while RXF is set and CPU core reads between the entries */
+static void stress_test(uint8_t pct)
+{
+    CANReceiveStatistic_TypeDef stat;
+
+    uint32_t step,n,entries = 0,received = 0,longest = 0;
+    uint8_t k;
+
+    model_start(pct);
+
+    for (step = 0; step < STEPS; step++)
+    {
+        /* Up to 7 frames arrive while XGATE is busy with other channels. */
+        k = (uint8_t)(random_u32() % 8u);
+
+        for (; k != 0; k--)host_trap_run(bus_frame);
+
+        while ((host_regs(CHANNEL)->RFLG & 0x01u) != 0)
+        {
+            n = handler_entry();
+
+            TEST_CHECK((n >= 1) && (n <= MSCAN_RXFIFO_DEPTH));
+
+            if (n > longest)longest = n;
+
+            entries++;
+
+            received += drain();
+        }
+    }
+
+    (void)host_trap_stop();
+
+    CAN_GetReceiveStatistic(CHANNEL, &stat);
+
+    TEST_CHECK(received + overrun == bus_seq);
+    TEST_CHECK(received == taken);
+    TEST_CHECK(stat.drop_count == 0);
+    TEST_CHECK(stat.burst_max == longest);
+
+    /* The counters stop before the frame counter wraps,a longer run only checks that they stopped together. */
+    if (taken <= 0xFFFFu)
+    {
+        TEST_CHECK(stat.entry_count == entries);
+        TEST_CHECK(stat.frame_count == taken);
+    }
+    else
+    {
+        TEST_CHECK(stat.frame_count > 0xFFFFu - MSCAN_RXFIFO_DEPTH);
+        TEST_CHECK((uint32_t)stat.entry_count * MSCAN_RXFIFO_DEPTH >= stat.frame_count);
+    }
+
+    printf("arrival %3u%% per frame:%u frames in %u handler entries,%.2f frames per entry,burst max %u,%u overrun\n",
+           (unsigned)pct, (unsigned)taken, (unsigned)entries, (double)taken / (double)entries,
+           (unsigned)stat.burst_max, (unsigned)overrun);
+}
+
+
+
+int main(void)
+{
+    fifo_test();
+
+    saturation_test();
+
+    stress_test(0);
+
+    stress_test(30);
+
+    stress_test(60);
+
+    return TEST_RESULT("test_burst");
+}
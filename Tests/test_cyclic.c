@@ -0,0 +1,91 @@
+/*
+   Cyclic message schedule of CAN_Message.c.The messages of the schedule table are taken out of
+   their send buffers by the real XGATE code after every RTI tick.
+*/
+#include "host_can.h"
+
+
+#define  TICKS              (1000u)
+
+
+
+int main(void)
+{
+    MSCAN_MessageTypeDef msg;
+    CANFrame_TypeDef frame;
+
+    uint32_t tick,key,sent[CAN_CYCLIC_NUM] = {0},first[CAN_CYCLIC_NUM] = {0},last[CAN_CYCLIC_NUM] = {0};
+    uint8_t i,k,ch,best;
+
+    CAN_MessageBuffer_Init();
+
+    memset(MSCAN_TxState, 0, sizeof(MSCAN_TxState));
+
+    /* The channels of the schedule have a single producer,the main loop cannot fill them. */
+    msg.frametype   = DataFrameWithStandardId;
+    msg.frame_id    = 0x123u;
+    msg.data_length = 0;
+
+    for (ch = 0; ch < CAN_CHANNEL_NUM; ch++)
+    {
+        for (i = 0; (i < sizeof(CAN_CyclicTable) / sizeof(CAN_CyclicTable[0])) && (CAN_CyclicTable[i].ch != ch); i++);
+
+        TEST_CHECK(Fill_CANSendBuffer((MSCAN_ChannelTypeDef)ch, &msg) == ((i < sizeof(CAN_CyclicTable) / sizeof(CAN_CyclicTable[0])) ? -1 : 0));
+    }
+
+    CAN_MessageBuffer_Init();
+
+    for (tick = 1; tick <= TICKS; tick++)
+    {
+        CAN_CyclicSchedule();
+
+        for (ch = 0; ch < CAN_CHANNEL_NUM; ch++)
+        {
+            while ((best = MSCAN_TxFindBest((MSCAN_ChannelTypeDef)ch, 0, &key)) != TX_NO_MESSAGE)
+            {
+                MSCAN_TxTake((MSCAN_ChannelTypeDef)ch, best, &frame);
+
+                for (i = 0; i < sizeof(CAN_CyclicTable) / sizeof(CAN_CyclicTable[0]); i++)
+                {
+                    if ((CAN_CyclicTable[i].ch == ch) && (CAN_CyclicTable[i].id == CAN_FrameId(frame.id)))break;
+                }
+
+                TEST_CHECK(i < sizeof(CAN_CyclicTable) / sizeof(CAN_CyclicTable[0]));
+
+                if (i == sizeof(CAN_CyclicTable) / sizeof(CAN_CyclicTable[0]))continue;
+
+                /* Sent once per period,with the payload of the table and zeros behind the data length */
+                if (sent[i] == 0)
+                {
+                    TEST_CHECK(tick <= CAN_CyclicTable[i].period);
+
+                    first[i] = tick;
+                }
+                else
+                {
+                    TEST_CHECK(tick - last[i] == CAN_CyclicTable[i].period);
+                }
+
+                last[i] = tick;
+
+                TEST_CHECK(frame.dlc == CAN_CyclicTable[i].data_length);
+
+                for (k = 0; k < 8; k++)
+                {
+                    if ((k < frame.dlc) && (CAN_CyclicTable[i].data != NULL))TEST_CHECK(frame.data[k] == CAN_CyclicTable[i].data[k]);
+                    if (k >= frame.dlc)TEST_CHECK(frame.data[k] == 0);
+                }
+
+                sent[i]++;
+            }
+        }
+    }
+
+    for (i = 0; i < sizeof(CAN_CyclicTable) / sizeof(CAN_CyclicTable[0]); i++)
+    {
+        if (CAN_CyclicTable[i].period == 0)TEST_CHECK(sent[i] == 0);
+        else TEST_CHECK((sent[i] != 0) && (sent[i] == (TICKS - first[i]) / CAN_CyclicTable[i].period + 1));
+    }
+
+    return TEST_RESULT("test_cyclic");
+}
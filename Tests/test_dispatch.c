@@ -0,0 +1,304 @@
+/*
+   Receive dispatch.Random ID ranges are registered against a plain list of the accepted ranges,
+   then random frames go through the receive buffers and CAN_DispatchReceiveBuffer(),and the
+   handler which the binary search calls is compared with a search of the whole list.
+*/
+#include "host_can.h"
+
+
+#define  ROUNDS             (200u)
+#define  FRAMES             (400u)                 /* Frames per round */
+#define  HANDLER_NUM        (4)
+
+/* A registered range of the reference list */
+typedef struct
+{
+    MSCAN_ChannelTypeDef ch;
+    uint8_t  ext;
+    uint32_t low;
+    uint32_t high;
+    AcceptFrameType frame_type;
+    uint8_t  handler;
+}RefRange_TypeDef;
+
+static RefRange_TypeDef ref[CAN_DISPATCH_SIZE];
+static uint8_t ref_num;
+
+static uint32_t lcg = 1;
+
+/* The last handler call */
+static int      called;
+static MSCAN_ChannelTypeDef called_ch;
+static MSCAN_MessageTypeDef called_msg;
+
+
+
+static uint32_t random_u32(void)
+{
+    lcg = lcg * 1103515245u + 12345u;
+
+    return (lcg >> 16) | ((lcg * 1103515245u + 12345u) & 0xFFFF0000u);
+}
+
+
+
+static void handler_call(int n, MSCAN_ChannelTypeDef CANx, MSCAN_MessageTypeDef* CAN_RMessage)
+{
+    TEST_CHECK(called == -1);
+
+    called     = n;
+    called_ch  = CANx;
+    called_msg = *CAN_RMessage;
+}
+
+static void handler0(MSCAN_ChannelTypeDef CANx, MSCAN_MessageTypeDef* CAN_RMessage) { handler_call(0, CANx, CAN_RMessage); }
+static void handler1(MSCAN_ChannelTypeDef CANx, MSCAN_MessageTypeDef* CAN_RMessage) { handler_call(1, CANx, CAN_RMessage); }
+static void handler2(MSCAN_ChannelTypeDef CANx, MSCAN_MessageTypeDef* CAN_RMessage) { handler_call(2, CANx, CAN_RMessage); }
+static void handler3(MSCAN_ChannelTypeDef CANx, MSCAN_MessageTypeDef* CAN_RMessage) { handler_call(3, CANx, CAN_RMessage); }
+
+static const CAN_MessageHandler handler[HANDLER_NUM] = {handler0, handler1, handler2, handler3};
+
+
+
+/* Index of the reference range which holds the ID,-1 if there is none */
+static int ref_find(MSCAN_ChannelTypeDef ch, uint8_t ext, uint32_t id)
+{
+    uint8_t i;
+
+    for (i = 0; i < ref_num; i++)
+    {
+        if ((ref[i].ch == ch) && (ref[i].ext == ext) && (id >= ref[i].low) && (id <= ref[i].high))return i;
+    }
+
+    return -1;
+}
+
+
+
+/* The table must hold the reference ranges in ascending key order */
+static void check_table(void)
+{
+    uint8_t i,k;
+    uint32_t key;
+
+    TEST_CHECK(CAN_DispatchNum == ref_num);
+
+    for (i = 0; i < CAN_DispatchNum; i++)
+    {
+        if (i != 0)TEST_CHECK(CAN_DispatchTable[i - 1].key_high < CAN_DispatchTable[i].key_low);
+
+        for (k = 0; k < ref_num; k++)
+        {
+            key = CAN_DispatchKey(ref[k].ch, ref[k].ext, ref[k].low);
+
+            if (key == CAN_DispatchTable[i].key_low)break;
+        }
+
+        TEST_CHECK(k < ref_num);
+
+        if (k == ref_num)continue;
+
+        TEST_CHECK(CAN_DispatchTable[i].key_high == CAN_DispatchKey(ref[k].ch, ref[k].ext, ref[k].high));
+        TEST_CHECK(CAN_DispatchTable[i].frame_type == ref[k].frame_type);
+        TEST_CHECK(CAN_DispatchTable[i].handler == handler[ref[k].handler]);
+    }
+}
+
+
+
+/* Register a random range,it must fail exactly when it overlaps a range of the list or the table is full */
+static void register_random(void)
+{
+    static const MSCAN_ChannelTypeDef chs[3] = {MSCAN_Channel0, MSCAN_Channel1, MSCAN_Channel4};
+
+    CANDispatchEntry_TypeDef saved[CAN_DISPATCH_SIZE];
+
+    RefRange_TypeDef r;
+
+    uint32_t mask,id,bits;
+    uint8_t i,expect;
+
+    r.ch         = chs[random_u32() % 3u];
+    r.ext        = (uint8_t)(random_u32() & 1u);
+    r.frame_type = (AcceptFrameType)(random_u32() % 3u);
+    r.handler    = (uint8_t)(random_u32() % HANDLER_NUM);
+
+    /* IDs are kept in a small space so that the ranges often overlap. */
+    bits = random_u32() % 7u;
+    mask = (1u << bits) - 1;
+    id   = (random_u32() & 0x1FFu) | (r.ext ? 0x18FE0000u : 0x300u);
+
+    r.low  = id & ~mask;
+    r.high = r.low | mask;
+
+    expect = (ref_num < CAN_DISPATCH_SIZE);
+
+    for (i = 0; i < ref_num; i++)
+    {
+        if ((ref[i].ch == r.ch) && (ref[i].ext == r.ext) && (r.low <= ref[i].high) && (ref[i].low <= r.high))expect = 0;
+    }
+
+    memcpy(saved, CAN_DispatchTable, sizeof(saved));
+
+    TEST_CHECK(CAN_RegisterHandler(r.ch, r.ext ? OnlyAcceptExtendedID : OnlyAcceptStandardID, r.frame_type, id, mask, handler[r.handler]) == (expect ? 0 : -1));
+
+    if (expect != 0)
+    {
+        ref[ref_num++] = r;
+    }
+    else
+    {
+        /* A refused range leaves the table as it was. */
+        TEST_CHECK(memcmp(saved, CAN_DispatchTable, ref_num * sizeof(saved[0])) == 0);
+    }
+}
+
+
+
+/* Put a frame into the receive buffer of a channel and dispatch it */
+static void dispatch_one(MSCAN_ChannelTypeDef ch, uint8_t ext, uint8_t rtr, uint32_t id)
+{
+    uint8_t data[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    uint8_t remote;
+    int k,expect;
+
+    host_rxfg_load(ch, ext, rtr, id, 8, data);
+    host_regs(ch)->RFLG = 0x01u;
+
+    TEST_CHECK(MSCAN_ReceiveOneFrame(ch) == 1);
+
+    k = ref_find(ch, ext, id);
+    expect = -1;
+
+    if (k >= 0)
+    {
+        remote = (rtr != 0);
+
+        if ((ref[k].frame_type == AcceptBothFrame) || (ref[k].frame_type == (remote ? OnlyAcceptRemoteFrame : OnlyAcceptDataFrame)))
+        {
+            expect = ref[k].handler;
+        }
+    }
+
+    called = -1;
+
+    TEST_CHECK(CAN_DispatchReceiveBuffer(ch, 4) == 1);
+    TEST_CHECK(called == expect);
+
+    if ((expect >= 0) && (called == expect))
+    {
+        TEST_CHECK(called_ch == ch);
+        TEST_CHECK(called_msg.frame_id == id);
+        TEST_CHECK(called_msg.frametype == (ext ? (rtr ? RemoteFrameWithExtendedId : DataFrameWithExtendedId)
+                                                : (rtr ? RemoteFrameWithStandardId : DataFrameWithStandardId)));
+    }
+}
+
+
+
+static void random_test(void)
+{
+    uint32_t round,n,id;
+    uint8_t ext,k;
+    MSCAN_ChannelTypeDef ch;
+
+    for (round = 0; round < ROUNDS; round++)
+    {
+        CAN_MessageBuffer_Init();
+
+        CAN_DispatchNum = 0;
+        ref_num = 0;
+
+        for (n = 0; n < 3u * CAN_DISPATCH_SIZE; n++)register_random();
+
+        check_table();
+
+        /* Channel 4 has the J1939 software filter,the dispatch is checked on the others. */
+        for (n = 0; n < FRAMES; n++)
+        {
+            ch  = (random_u32() & 1u) ? MSCAN_Channel1 : MSCAN_Channel0;
+            ext = (uint8_t)(random_u32() & 1u);
+            id  = (random_u32() & 0x1FFu) | (ext ? 0x18FE0000u : 0x300u);
+
+            /* Hit the edges of the ranges,and the IDs just outside them. */
+            if ((ref_num != 0) && ((n & 1u) != 0))
+            {
+                k   = (uint8_t)(random_u32() % ref_num);
+                ch  = ref[k].ch;
+                ext = ref[k].ext;
+                id  = (n & 2u) ? ref[k].low : ref[k].high;
+
+                if ((n & 4u) != 0)id += (n & 2u) ? -1 : 1;
+
+                if (ch == MSCAN_Channel4)ch = MSCAN_Channel0;
+            }
+
+            dispatch_one(ch, ext, (uint8_t)((random_u32() & 3u) == 0), id);
+        }
+    }
+}
+
+
+
+/* Invalid parameters are refused and leave the table as it was */
+static void param_test(void)
+{
+    CAN_DispatchNum = 0;
+
+    TEST_CHECK(CAN_RegisterHandler(MSCAN_Channel0, OnlyAcceptStandardID, AcceptBothFrame, 0x100u, 0, NULL) == -1);
+    TEST_CHECK(CAN_RegisterHandler(MSCAN_Channel0, OnlyAcceptStandardID, AcceptBothFrame, 0x100u, 0xF0u, handler0) == -1);
+    TEST_CHECK(CAN_RegisterHandler(MSCAN_Channel0, OnlyAcceptStandardID, AcceptBothFrame, 0x800u, 0, handler0) == -1);
+    TEST_CHECK(CAN_RegisterHandler(MSCAN_Channel0, OnlyAcceptStandardID, AcceptBothFrame, 0x100u, 0xFFFu, handler0) == -1);
+    TEST_CHECK(CAN_RegisterHandler(MSCAN_Channel0, OnlyAcceptExtendedID, AcceptBothFrame, 0x20000000u, 0, handler0) == -1);
+    TEST_CHECK(CAN_RegisterHandler(MSCAN_Channel0, (AcceptIDFormat)2, AcceptBothFrame, 0x100u, 0, handler0) == -1);
+    TEST_CHECK(CAN_RegisterHandler(MSCAN_Channel0, OnlyAcceptStandardID, (AcceptFrameType)3, 0x100u, 0, handler0) == -1);
+    TEST_CHECK(CAN_RegisterHandler((MSCAN_ChannelTypeDef)(MSCAN_Channel4 + 1), OnlyAcceptStandardID, AcceptBothFrame, 0x100u, 0, handler0) == -1);
+
+    TEST_CHECK(CAN_DispatchNum == 0);
+
+    /* The same ID on another channel or in the other format is another range. */
+    TEST_CHECK(CAN_RegisterHandler(MSCAN_Channel0, OnlyAcceptStandardID, AcceptBothFrame, 0x100u, 0, handler0) == 0);
+    TEST_CHECK(CAN_RegisterHandler(MSCAN_Channel1, OnlyAcceptStandardID, AcceptBothFrame, 0x100u, 0, handler1) == 0);
+    TEST_CHECK(CAN_RegisterHandler(MSCAN_Channel0, OnlyAcceptExtendedID, AcceptBothFrame, 0x100u, 0, handler2) == 0);
+    TEST_CHECK(CAN_RegisterHandler(MSCAN_Channel0, OnlyAcceptStandardID, AcceptBothFrame, 0x100u, 0, handler3) == -1);
+
+    TEST_CHECK(CAN_DispatchNum == 3);
+}
+
+
+
+/* CAN_DispatchReceiveBuffer() reads no more than max_num messages */
+static void max_num_test(void)
+{
+    uint8_t i;
+
+    CAN_MessageBuffer_Init();
+
+    CAN_DispatchNum = 0;
+
+    for (i = 0; i < 10; i++)
+    {
+        host_rxfg_load(MSCAN_Channel0, 0, 0, 0x123u, 0, NULL);
+        host_regs(MSCAN_Channel0)->RFLG = 0x01u;
+
+        TEST_CHECK(MSCAN_ReceiveOneFrame(MSCAN_Channel0) == 1);
+    }
+
+    TEST_CHECK(CAN_DispatchReceiveBuffer(MSCAN_Channel0, 4) == 4);
+    TEST_CHECK(CAN_DispatchReceiveBuffer(MSCAN_Channel0, 4) == 4);
+    TEST_CHECK(CAN_DispatchReceiveBuffer(MSCAN_Channel0, 4) == 2);
+    TEST_CHECK(CAN_DispatchReceiveBuffer(MSCAN_Channel0, 4) == 0);
+}
+
+
+
+int main(void)
+{
+    param_test();
+
+    random_test();
+
+    max_num_test();
+
+    return TEST_RESULT("test_dispatch");
+}
@@ -0,0 +1,200 @@
+/*
+   Index math of the rings with free running pointers.The pointers are started at several values,
+   so they wrap past 255 and the slots wrap past the end of the ring at every possible place,and
+   the rings are filled past full under every receive overflow policy.
+*/
+#include "host_can.h"
+
+
+#define  RX_CHANNEL         MSCAN_Channel1
+#define  RX_ID_BASE         (0x18FE0000u)
+#define  TX_CHANNEL         MSCAN_Channel0
+#define  TX_ID              (0x0CF00400u)
+#define  EXTRA              (3u)                   /* Frames beyond full */
+
+
+
+/* XGATE:receive the frame with the sequence number seq */
+static void rx_put(uint8_t seq)
+{
+    uint8_t i,data[8];
+
+    for (i = 0; i < 8; i++)data[i] = (uint8_t)(seq + i);
+
+    host_rxfg_load(RX_CHANNEL, 1, 0, RX_ID_BASE | seq, 8, data);
+
+    host_regs(RX_CHANNEL)->RFLG = 0x01u;
+
+    TEST_CHECK(MSCAN_ReceiveOneFrame(RX_CHANNEL) == 1);
+    TEST_CHECK(host_regs(RX_CHANNEL)->RFLG == 0x01u);
+}
+
+
+
+/* CPU core:read the ring by batches of 1 to 7 frames and compare the frames with the expected sequence numbers */
+static void rx_expect(const uint8_t* seq, uint8_t num)
+{
+    MSCAN_MessageTypeDef msg[7];
+
+    uint8_t got = 0,max = 1,i;
+    int n,k;
+
+    while (got < num)
+    {
+        n = Check_CANReceiveBuffer_Batch(RX_CHANNEL, msg, max);
+
+        TEST_CHECK(n == ((num - got < max) ? (num - got) : max));
+
+        if (n <= 0)return;
+
+        for (k = 0; k < n; k++, got++)
+        {
+            TEST_CHECK(msg[k].frame_id == (RX_ID_BASE | seq[got]));
+            TEST_CHECK(msg[k].data_length == 8);
+
+            for (i = 0; i < 8; i++)TEST_CHECK(msg[k].data[i] == (uint8_t)(seq[got] + i));
+        }
+
+        max = (max % 7u) + 1;
+    }
+
+    TEST_CHECK(Check_CANReceiveBuffer(RX_CHANNEL, &msg[0]) == -1);
+    TEST_CHECK(Check_CANReceiveBuffer_Batch(RX_CHANNEL, msg, 7) == 0);
+}
+
+
+
+static void rx_test(CAN_OverflowPolicyTypeDef policy, uint8_t start)
+{
+    CANReceiveStatistic_TypeDef stat;
+
+    uint8_t seq[256],depth,num,i;
+
+    CAN_MessageBuffer_Init();
+
+    g_CANx_RecBuffer.stat[RX_CHANNEL].policy = (uint8_t)policy;
+    g_CANx_RecBuffer.ch[RX_CHANNEL].WPointer = start;
+    g_CANx_RecBuffer.ch[RX_CHANNEL].RPointer = start;
+
+    depth = g_CANx_RecBuffer.ch[RX_CHANNEL].mask + 1;
+
+    for (i = 0; i < depth + EXTRA; i++)rx_put(i);
+
+    /* Frames which are left after the ring ran full by EXTRA frames */
+    for (num = 0; num < depth; num++)
+    {
+        if (policy == CAN_DropNewest)seq[num] = num;
+        else if (policy == CAN_DropOldest)seq[num] = num + EXTRA;
+        else seq[num] = (num == depth - 1) ? (depth + EXTRA - 1) : num;
+    }
+
+    TEST_CHECK((uint8_t)(g_CANx_RecBuffer.ch[RX_CHANNEL].WPointer - g_CANx_RecBuffer.ch[RX_CHANNEL].RPointer) == depth);
+
+    rx_expect(seq, num);
+
+    CAN_GetReceiveStatistic(RX_CHANNEL, &stat);
+
+    TEST_CHECK(stat.drop_count == EXTRA);
+    TEST_CHECK(stat.high_water == depth);
+
+    /* The ring is usable again after it ran full. */
+    for (i = 0; i < depth - 1; i++)
+    {
+        rx_put((uint8_t)(100u + i));
+        seq[i] = (uint8_t)(100u + i);
+    }
+
+    rx_expect(seq, depth - 1);
+
+    TEST_CHECK(g_CANx_RecBuffer.ch[RX_CHANNEL].RPointer == (uint8_t)(start + depth + depth - 1 + ((policy == CAN_DropOldest) ? EXTRA : 0)));
+}
+
+
+
+/* CPU core:fill the frame with the sequence number seq */
+static int16_t tx_put(uint8_t seq)
+{
+    MSCAN_MessageTypeDef msg;
+
+    uint8_t i;
+
+    msg.frametype   = DataFrameWithExtendedId;
+    msg.frame_id    = TX_ID;
+    msg.data_length = 8;
+
+    for (i = 0; i < 8; i++)msg.data[i] = (uint8_t)(seq + i);
+
+    return Fill_CANSendBuffer(TX_CHANNEL, &msg);
+}
+
+
+
+/* XGATE:take all frames,they have the same ID and leave the ring in the filling order */
+static void tx_expect(uint8_t first, uint8_t num)
+{
+    CANFrame_TypeDef frame;
+
+    uint32_t key;
+    uint8_t i,k;
+
+    for (k = 0; k < num; k++)
+    {
+        TEST_CHECK(MSCAN_TxFindBest(TX_CHANNEL, 0, &key) == 0);
+
+        MSCAN_TxTake(TX_CHANNEL, 0, &frame);
+
+        TEST_CHECK(CAN_FrameId(frame.id) == TX_ID);
+
+        for (i = 0; i < 8; i++)TEST_CHECK(frame.data[i] == (uint8_t)(first + k + i));
+    }
+
+    TEST_CHECK(MSCAN_TxFindBest(TX_CHANNEL, 0, &key) == TX_NO_MESSAGE);
+}
+
+
+
+static void tx_test(uint8_t start)
+{
+    uint8_t depth,i;
+
+    CAN_MessageBuffer_Init();
+
+    memset(&MSCAN_TxState[TX_CHANNEL], 0, sizeof(MSCAN_TxState[TX_CHANNEL]));
+
+    g_CANx_SendBuffer.ch[TX_CHANNEL].WPointer = start;
+    g_CANx_SendBuffer.ch[TX_CHANNEL].RPointer = start;
+
+    depth = g_CANx_SendBuffer.ch[TX_CHANNEL].mask + 1;
+
+    for (i = 0; i < depth; i++)TEST_CHECK(tx_put(i) == 0);
+
+    TEST_CHECK(tx_put(depth) == -1);
+
+    tx_expect(0, depth);
+
+    for (i = 0; i < depth - 1; i++)TEST_CHECK(tx_put((uint8_t)(100u + i)) == 0);
+
+    tx_expect(100, depth - 1);
+
+    TEST_CHECK(g_CANx_SendBuffer.ch[TX_CHANNEL].WPointer == (uint8_t)(start + depth + depth - 1));
+}
+
+
+
+int main(void)
+{
+    static const uint8_t start[] = {0, 1, 7, 100, 240, 250, 253, 255};
+
+    uint8_t i;
+
+    for (i = 0; i < sizeof(start); i++)
+    {
+        rx_test(CAN_DropNewest, start[i]);
+        rx_test(CAN_DropOldest, start[i]);
+        rx_test(CAN_OverwriteLatest, start[i]);
+
+        tx_test(start[i]);
+    }
+
+    return TEST_RESULT("test_ring");
+}
@@ -0,0 +1,276 @@
+/*
+   Software acceptance filter.The tables are built by CAN_SoftFilter_Init() from test lists and
+   every lookup goes through the real MSCAN_SoftFilterAccept() of XGATE with the frame in the
+   receive foreground buffer.The result is compared with a plain search of the list.
+*/
+#include "host_can.h"
+
+
+#define  ID_CHANNEL         MSCAN_Channel0         /* Configured CAN_SoftFilterOff,switched to CAN_SoftFilterId */
+#define  J1939_CHANNEL      MSCAN_Channel4         /* Configured CAN_SoftFilterJ1939 */
+#define  RANDOM_IDS         (200000u)
+
+static uint32_t lcg = 1;
+
+
+
+static uint32_t random_u32(void)
+{
+    lcg = lcg * 1103515245u + 12345u;
+
+    return (lcg >> 16) | ((lcg * 1103515245u + 12345u) & 0xFFFF0000u);
+}
+
+
+
+/* PGN of an extended ID,written down from the J1939 layout instead of CAN_J1939_PGN() */
+static uint32_t ref_pgn(uint32_t id)
+{
+    uint32_t dp = (id >> 24) & 0x03u;
+    uint32_t pf = (id >> 16) & 0xFFu;
+    uint32_t ps = (id >> 8) & 0xFFu;
+
+    return (dp << 16) | (pf << 8) | ((pf >= 240u) ? ps : 0u);
+}
+
+
+
+/* Plain search of the list */
+static uint8_t ref_accept(const CANAcceptId_TypeDef* list, uint16_t num, MSCAN_ChannelTypeDef ch, uint8_t j1939, uint8_t ext, uint32_t id)
+{
+    uint16_t i;
+
+    for (i = 0; i < num; i++)
+    {
+        if ((list[i].ch != ch) || ((list[i].id_format == OnlyAcceptExtendedID) != (ext != 0)))continue;
+
+        if (ext == 0)
+        {
+            if ((list[i].id & 0x7FFu) == id)return 1;
+        }
+        else if (j1939 != 0)
+        {
+            if (ref_pgn(list[i].id) == ref_pgn(id))return 1;
+        }
+        else
+        {
+            if ((list[i].id & 0x1FFFFFFFu) == id)return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+
+/* XGATE:look up a frame of the channel */
+static uint8_t accept(MSCAN_ChannelTypeDef ch, uint8_t ext, uint32_t id)
+{
+    host_rxfg_load(ch, ext, 0, id, 0, NULL);
+
+    return MSCAN_SoftFilterAccept(ch, host_regs(ch));
+}
+
+
+
+/* Build the tables,the ID channel compares the whole extended ID */
+static void build(const CANAcceptId_TypeDef* list, uint16_t num)
+{
+    CAN_SoftFilter_Init(list, num);
+
+    if (g_CAN_SoftFilter.mode[ID_CHANNEL] == (uint8_t)CAN_SoftFilterOff)
+    {
+        g_CAN_SoftFilter.mode[ID_CHANNEL] = (uint8_t)CAN_SoftFilterId;
+    }
+}
+
+
+
+/* The probe bound of a channel is the longest distance of a stored key from its hash slot */
+static void check_probe(MSCAN_ChannelTypeDef ch)
+{
+    uint8_t i,dist,longest = 0;
+    uint32_t key;
+
+    for (i = 0; i < CAN_SOFTFILTER_HASH_SIZE; i++)
+    {
+        key = g_CAN_SoftFilter.ext_hash[ch][i];
+
+        if (key == 0)continue;
+
+        dist = (uint8_t)(i - CAN_SOFTFILTER_HASH(key & ~CAN_SOFTFILTER_VALID)) & (CAN_SOFTFILTER_HASH_SIZE - 1);
+
+        if (dist > longest)longest = dist;
+    }
+
+    TEST_CHECK(g_CAN_SoftFilter.probe[ch] == longest);
+}
+
+
+
+/* Standard IDs are looked up in the bitmap,every ID is tried */
+static void std_test(void)
+{
+    static const CANAcceptId_TypeDef list[] =
+    {
+        {ID_CHANNEL,    OnlyAcceptStandardID, 0x000u},
+        {ID_CHANNEL,    OnlyAcceptStandardID, 0x123u},
+        {ID_CHANNEL,    OnlyAcceptStandardID, 0x124u},
+        {ID_CHANNEL,    OnlyAcceptStandardID, 0x7FFu},
+        {ID_CHANNEL,    OnlyAcceptStandardID, 0xF55u},    /* Only the low 11 bits count */
+        {J1939_CHANNEL, OnlyAcceptStandardID, 0x301u},
+    };
+
+    uint16_t num = sizeof(list) / sizeof(list[0]);
+    uint32_t id;
+
+    build(list, num);
+
+    for (id = 0; id < 0x800u; id++)
+    {
+        TEST_CHECK(accept(ID_CHANNEL, 0, id) == ref_accept(list, num, ID_CHANNEL, 0, 0, id));
+        TEST_CHECK(accept(J1939_CHANNEL, 0, id) == ref_accept(list, num, J1939_CHANNEL, 1, 0, id));
+    }
+
+    /* A channel with no extended ID in the list rejects all of them. */
+    TEST_CHECK(accept(ID_CHANNEL, 1, 0x123u) == 0);
+}
+
+
+
+/* Extended IDs of a J1939 channel are compared by PGN,PDU1 PGNs accept every destination */
+static void j1939_test(void)
+{
+    static const CANAcceptId_TypeDef list[] =
+    {
+        {J1939_CHANNEL, OnlyAcceptExtendedID, 0x18901212u},     /* PDU1,PGN 0x09000 */
+        {J1939_CHANNEL, OnlyAcceptExtendedID, 0x18EAFF00u},     /* PDU1,request */
+        {J1939_CHANNEL, OnlyAcceptExtendedID, 0x18FEF100u},     /* PDU2,PGN 0x0FEF1 */
+        {J1939_CHANNEL, OnlyAcceptExtendedID, 0x0CF00400u},     /* PDU2,PGN 0x0F004 */
+        {J1939_CHANNEL, OnlyAcceptExtendedID, 0x19FECA00u},     /* PDU2 with data page */
+    };
+
+    uint16_t num = sizeof(list) / sizeof(list[0]);
+    uint32_t i,id;
+
+    build(list, num);
+
+    check_probe(J1939_CHANNEL);
+
+    /* Other destination,source and priority of the same PGN */
+    TEST_CHECK(accept(J1939_CHANNEL, 1, 0x0C9056F4u) == 1);
+    TEST_CHECK(accept(J1939_CHANNEL, 1, 0x18EA0017u) == 1);
+    TEST_CHECK(accept(J1939_CHANNEL, 1, 0x08FEF1AAu) == 1);
+
+    /* Other PS of a PDU2 PGN,and the same PGN on the other data page */
+    TEST_CHECK(accept(J1939_CHANNEL, 1, 0x18FEF200u) == 0);
+    TEST_CHECK(accept(J1939_CHANNEL, 1, 0x18FECA00u) == 0);
+    TEST_CHECK(accept(J1939_CHANNEL, 1, 0x19901212u) == 0);
+
+    for (i = 0; i < RANDOM_IDS; i++)
+    {
+        id = random_u32() & 0x1FFFFFFFu;
+
+        /* Half of the tries hit a PGN of the list with random other fields. */
+        if ((i & 1u) != 0)id = (list[i % num].id & 0x03FF0000u) | (id & 0x1C00FFFFu);
+
+        TEST_CHECK(accept(J1939_CHANNEL, 1, id) == ref_accept(list, num, J1939_CHANNEL, 1, 1, id));
+    }
+}
+
+
+
+/* Fill the hash table of the ID channel up to its size,with keys chosen to collide */
+static void hash_test(void)
+{
+    static CANAcceptId_TypeDef list[CAN_SOFTFILTER_HASH_SIZE + 2];
+
+    uint16_t num,i;
+    uint32_t id;
+
+    /* The IDs step through the bits which the hash folds onto each other. */
+    for (i = 0; i < CAN_SOFTFILTER_HASH_SIZE; i++)
+    {
+        list[i].ch        = ID_CHANNEL;
+        list[i].id_format = OnlyAcceptExtendedID;
+        list[i].id        = 0x10000000u | ((uint32_t)(i & 7u) << 8) | ((uint32_t)(i >> 3) << 16) | ((i & 7u) ^ (i >> 3));
+    }
+
+    /* A repeated ID takes one entry. */
+    list[i] = list[5];
+
+    num = CAN_SOFTFILTER_HASH_SIZE + 1;
+
+    build(list, num);
+
+    TEST_CHECK(g_CAN_SoftFilter.mode[ID_CHANNEL] == (uint8_t)CAN_SoftFilterId);
+
+    check_probe(ID_CHANNEL);
+
+    for (i = 0; i < CAN_SOFTFILTER_HASH_SIZE; i++)TEST_CHECK(accept(ID_CHANNEL, 1, list[i].id) == 1);
+
+    for (i = 0; i < 20000u; i++)
+    {
+        id = random_u32() & 0x1FFFFFFFu;
+
+        if ((i & 1u) != 0)id = (list[i % CAN_SOFTFILTER_HASH_SIZE].id ^ (1u << (i % 29u)));
+
+        TEST_CHECK(accept(ID_CHANNEL, 1, id) == ref_accept(list, num, ID_CHANNEL, 0, 1, id));
+    }
+
+    printf("hash table full:probe bound %u\n", (unsigned)g_CAN_SoftFilter.probe[ID_CHANNEL] + 1);
+
+    /* One more key does not fit,the channel falls back to accepting every frame. */
+    list[num].ch        = ID_CHANNEL;
+    list[num].id_format = OnlyAcceptExtendedID;
+    list[num].id        = 0x1FFFFFFFu;
+
+    CAN_SoftFilter_Init(list, num + 1);
+
+    TEST_CHECK(g_CAN_SoftFilter.mode[ID_CHANNEL] == (uint8_t)CAN_SoftFilterOff);
+    TEST_CHECK(accept(ID_CHANNEL, 1, 0x00000001u) == 1);
+    TEST_CHECK(accept(ID_CHANNEL, 0, 0x001u) == 1);
+}
+
+
+
+/* A rejected frame takes no slot and is counted */
+static void receive_test(void)
+{
+    CANReceiveStatistic_TypeDef stat;
+    MSCAN_MessageTypeDef msg;
+
+    CAN_MessageBuffer_Init();
+
+    host_rxfg_load(J1939_CHANNEL, 1, 0, 0x18FEF100u, 8, NULL);
+    host_regs(J1939_CHANNEL)->RFLG = 0x01u;
+
+    TEST_CHECK(MSCAN_ReceiveOneFrame(J1939_CHANNEL) == 1);
+
+    host_rxfg_load(J1939_CHANNEL, 1, 0, 0x18901234u, 8, NULL);
+    host_regs(J1939_CHANNEL)->RFLG = 0x01u;
+
+    TEST_CHECK(MSCAN_ReceiveOneFrame(J1939_CHANNEL) == 1);
+
+    CAN_GetReceiveStatistic(J1939_CHANNEL, &stat);
+
+    TEST_CHECK(stat.reject_count == 1);
+    TEST_CHECK(Check_CANReceiveBuffer(J1939_CHANNEL, &msg) == 0);
+    TEST_CHECK(msg.frame_id == 0x18901234u);
+    TEST_CHECK(Check_CANReceiveBuffer(J1939_CHANNEL, &msg) == -1);
+}
+
+
+
+int main(void)
+{
+    std_test();
+
+    j1939_test();
+
+    hash_test();
+
+    receive_test();
+
+    return TEST_RESULT("test_softfilter");
+}
@@ -0,0 +1,537 @@
+/*
+   Tests of the single producer/single consumer rings between XGATE and CPU core.The XGATE side
+   runs the real receive and transmit code of xgate.cxgate,the CPU core side runs CAN_Message.c.
+   Every frame carries its sequence number,so a frame which is torn,lost,duplicated or taken out
+   of order is found.
+
+   The rings are tested in two ways:
+   - Two threads,one for each core,which only meet at random preemption points on a host with
+     a single CPU.
+   - The store trap of host_trap.h,which runs the other core after every single store into the
+     buffers,once with the producer and once with the consumer trapped,so every interleaving of
+     the two sides is covered.
+*/
+#include <pthread.h>
+#include <sched.h>
+
+#include "host_can.h"
+#include "host_trap.h"
+
+
+#define  RX_CHANNEL         MSCAN_Channel1
+#define  RX_FRAMES          (50000u)
+#define  RX_ID_BASE         (0x18FE0000u)          /* The low 16 bits carry the sequence number */
+
+#define  TX_CHANNEL         MSCAN_Channel0
+#define  TX_FRAMES          (50000u)
+#define  TX_ID_NUM          (3)
+
+#define  TRAP_FRAMES        (4000u)                /* Frames of each trapped run,every store costs two signals */
+
+static const uint32_t tx_id[TX_ID_NUM] = {0x0C000010u, 0x10000020u, 0x18000030u};
+
+static volatile int producer_done;
+static volatile int producer_errors;
+
+
+
+/* Data byte i of the frame with the sequence number seq */
+static uint8_t frame_byte(uint32_t seq, uint8_t i)
+{
+    return (uint8_t)(seq * 7u + i);
+}
+
+
+
+/*
+   Receive ring.The state of the test is volatile,because the trap callbacks change it from a
+   signal handler.
+*/
+static volatile uint32_t rx_seq;                    /* Next frame of the producer */
+static volatile uint32_t rx_expected,rx_received,rx_dropped;
+static volatile uint32_t rx_calls;                  /* Callbacks of the trapped run */
+
+
+
+/* XGATE:receive the next frame */
+static void rx_produce(void)
+{
+    uint8_t i,data[8];
+
+    for (i = 0; i < 8; i++)data[i] = frame_byte(rx_seq, i);
+
+    host_rxfg_load(RX_CHANNEL, 1, 0, RX_ID_BASE | (rx_seq & 0xFFFFu), (uint8_t)(rx_seq % 9u), data);
+
+    host_regs(RX_CHANNEL)->RFLG = 0x01u;
+
+    if (MSCAN_ReceiveOneFrame(RX_CHANNEL) != 1)producer_errors++;
+
+    rx_seq++;
+}
+
+
+
+/* CPU core:check the frames read from the receive ring */
+static void rx_check(const MSCAN_MessageTypeDef* msg, int n)
+{
+    uint32_t seq;
+    uint8_t i,ok;
+    int k;
+
+    for (k = 0; k < n; k++)
+    {
+        seq = rx_expected + ((msg[k].frame_id - rx_expected) & 0xFFFFu);
+
+        ok = (msg[k].frametype == DataFrameWithExtendedId)
+          && ((msg[k].frame_id & 0xFFFF0000u) == RX_ID_BASE)
+          && (msg[k].data_length == seq % 9u);
+
+        for (i = 0; ok && (i < msg[k].data_length); i++)ok = (msg[k].data[i] == frame_byte(seq, i));
+
+        TEST_CHECK(ok);
+
+        /* A skipped sequence number is a dropped frame,a smaller one would be out of order. */
+        rx_dropped += seq - rx_expected;
+        rx_expected = seq + 1;
+        rx_received++;
+    }
+}
+
+
+
+/* CPU core:read one frame or a batch of frames,returns the number of frames read */
+static int rx_consume(int batch)
+{
+    MSCAN_MessageTypeDef msg[5];
+
+    int n;
+
+    if (batch != 0)
+    {
+        n = Check_CANReceiveBuffer_Batch(RX_CHANNEL, msg, 5);
+    }
+    else
+    {
+        n = (Check_CANReceiveBuffer(RX_CHANNEL, &msg[0]) == 0) ? 1 : 0;
+    }
+
+    rx_check(msg, n);
+
+    return n;
+}
+
+
+
+static void rx_start(void)
+{
+    CAN_MessageBuffer_Init();
+
+    rx_seq = 0;
+    rx_expected = 0;
+    rx_received = 0;
+    rx_dropped = 0;
+    rx_calls = 0;
+
+    producer_done = 0;
+    producer_errors = 0;
+}
+
+
+
+/* Check the counts when all frames were produced and the ring is empty */
+static void rx_finish(const char* name, uint32_t frames)
+{
+    CANReceiveStatistic_TypeDef stat;
+
+    rx_dropped += frames - rx_expected;
+
+    CAN_GetReceiveStatistic(RX_CHANNEL, &stat);
+
+    TEST_CHECK(producer_errors == 0);
+    TEST_CHECK(rx_received + rx_dropped == frames);
+    TEST_CHECK(rx_dropped == stat.drop_count);
+    TEST_CHECK(stat.high_water <= ECU_RECEIVEBUF_SIZE);
+
+    printf("receive ring,%s: %u frames read,%u dropped,high water %u\n",
+           name, (unsigned)rx_received, (unsigned)rx_dropped, (unsigned)stat.high_water);
+}
+
+
+
+/* XGATE thread:every fourth frame does not wait for a free slot and may be dropped */
+static void* rx_producer(void* arg)
+{
+    volatile CANBufferDescriptor_TypeDef* desc = &g_CANx_RecBuffer.ch[RX_CHANNEL];
+
+    (void)arg;
+
+    while (rx_seq < RX_FRAMES)
+    {
+        if ((rx_seq & 3u) != 0)
+        {
+            while ((uint8_t)(desc->WPointer - desc->RPointer) > desc->mask)sched_yield();
+        }
+
+        rx_produce();
+    }
+
+    producer_done = 1;
+
+    return NULL;
+}
+
+
+
+static void rx_thread_test(void)
+{
+    pthread_t thread;
+
+    int n,done,batch = 0;
+
+    rx_start();
+
+    pthread_create(&thread, NULL, rx_producer, NULL);
+
+    for (;;)
+    {
+        done = producer_done;
+
+        n = rx_consume(batch);
+
+        batch = !batch;
+
+        if ((n == 0) && (done != 0))break;
+    }
+
+    pthread_join(thread, NULL);
+
+    rx_finish("two threads", RX_FRAMES);
+}
+
+
+
+/*
+   The consumer runs after every store of the producer.It reads once every 1,4,16 or 64 stores,
+   so the ring also runs full and drops.
+*/
+static void rx_consumer_callback(volatile void* addr)
+{
+    uint32_t period = 1u << (((rx_seq / 500u) & 3u) * 2u);
+
+    (void)addr;
+
+    if ((rx_calls++ % period) == 0)(void)rx_consume((int)(rx_calls & 1u));
+}
+
+
+
+/* The producer runs after every store of the consumer,a burst every 64 stores fills the ring */
+static void rx_producer_callback(volatile void* addr)
+{
+    uint8_t n = ((rx_calls++ & 63u) == 0) ? 24 : 1;
+
+    (void)addr;
+
+    for (; (n != 0) && (rx_seq < TRAP_FRAMES); n--)rx_produce();
+}
+
+
+
+static void rx_trap_test(void)
+{
+    int batch = 0;
+
+    /* The producer is trapped. */
+    rx_start();
+
+    host_trap_start(&g_CANx_RecBuffer, sizeof(g_CANx_RecBuffer), rx_consumer_callback);
+
+    while (rx_seq < TRAP_FRAMES)rx_produce();
+
+    (void)host_trap_stop();
+
+    while (rx_consume(0) != 0);
+
+    rx_finish("consumer after every producer store", TRAP_FRAMES);
+
+    /* The consumer is trapped,an empty ring makes no store and the producer goes on by itself. */
+    rx_start();
+
+    host_trap_start(&g_CANx_RecBuffer, sizeof(g_CANx_RecBuffer), rx_producer_callback);
+
+    while ((rx_seq < TRAP_FRAMES) || (rx_received + rx_dropped < TRAP_FRAMES))
+    {
+        if (rx_consume(batch) == 0)
+        {
+            if (rx_seq >= TRAP_FRAMES)break;
+
+            host_trap_run(rx_produce);
+        }
+
+        batch = !batch;
+    }
+
+    (void)host_trap_stop();
+
+    while (rx_consume(0) != 0);
+
+    rx_finish("producer after every consumer store", TRAP_FRAMES);
+}
+
+
+
+/*
+   Send ring
+*/
+static volatile uint32_t tx_seq,tx_lcg;
+static volatile uint32_t tx_sent[TX_ID_NUM];
+static volatile uint32_t tx_last[TX_ID_NUM];
+static volatile uint32_t tx_count[TX_ID_NUM];
+static volatile uint32_t tx_calls;
+
+
+
+/* CPU core:fill the next frame,returns 0 when it was filled and -1 when the ring is full */
+static int tx_produce(void)
+{
+    MSCAN_MessageTypeDef msg;
+
+    uint8_t i,k;
+
+    k = (uint8_t)((tx_lcg >> 16) % TX_ID_NUM);
+
+    msg.frametype   = DataFrameWithExtendedId;
+    msg.frame_id    = tx_id[k];
+    msg.data_length = 8;
+
+    for (i = 0; i < 8; i++)msg.data[i] = frame_byte(tx_seq, i);
+
+    msg.data[0] = (uint8_t)tx_seq;
+    msg.data[1] = (uint8_t)(tx_seq >> 8);
+    msg.data[2] = (uint8_t)(tx_seq >> 16);
+    msg.data[3] = (uint8_t)(tx_seq >> 24);
+
+    if (Fill_CANSendBuffer(TX_CHANNEL, &msg) != 0)return -1;
+
+    tx_sent[k]++;
+    tx_seq++;
+    tx_lcg = tx_lcg * 1103515245u + 12345u;
+
+    return 0;
+}
+
+
+
+static void tx_produce_one(void)
+{
+    (void)tx_produce();
+}
+
+
+
+/* XGATE:take the waiting frame with the highest priority,returns 0 when the ring is empty */
+static int tx_consume(void)
+{
+    uint8_t best,k;
+    uint32_t key,seq,id;
+
+    CANFrame_TypeDef frame;
+
+    best = MSCAN_TxFindBest(TX_CHANNEL, 0, &key);
+
+    if (best == TX_NO_MESSAGE)return 0;
+
+    MSCAN_TxTake(TX_CHANNEL, best, &frame);
+
+    id  = CAN_FrameId(frame.id);
+    seq = (uint32_t)frame.data[0] | ((uint32_t)frame.data[1] << 8)
+        | ((uint32_t)frame.data[2] << 16) | ((uint32_t)frame.data[3] << 24);
+
+    for (k = 0; (k < TX_ID_NUM) && (tx_id[k] != id); k++);
+
+    /* Frames of the same ID keep the filling order. */
+    if ((k == TX_ID_NUM) || (frame.dlc != 8) || (frame.data[7] != frame_byte(seq, 7))
+     || ((tx_count[k] != 0) && (seq <= tx_last[k])))
+    {
+        producer_errors++;
+        return 1;
+    }
+
+    tx_last[k] = seq;
+    tx_count[k]++;
+
+    return 1;
+}
+
+
+
+static void tx_consume_one(void)
+{
+    (void)tx_consume();
+}
+
+
+
+static void tx_start(void)
+{
+    uint8_t k;
+
+    CAN_MessageBuffer_Init();
+
+    /* The held message and the key of the busy buffers are not used. */
+    memset(&MSCAN_TxState[TX_CHANNEL], 0, sizeof(MSCAN_TxState[TX_CHANNEL]));
+
+    for (k = 0; k < TX_ID_NUM; k++)
+    {
+        tx_sent[k]  = 0;
+        tx_last[k]  = 0;
+        tx_count[k] = 0;
+    }
+
+    tx_seq = 0;
+    tx_lcg = 1;
+    tx_calls = 0;
+
+    producer_done = 0;
+    producer_errors = 0;
+}
+
+
+
+static void tx_finish(const char* name)
+{
+    uint8_t k;
+
+    TEST_CHECK(producer_errors == 0);
+
+    for (k = 0; k < TX_ID_NUM; k++)TEST_CHECK(tx_count[k] == tx_sent[k]);
+
+    TEST_CHECK(g_CANx_SendBuffer.ch[TX_CHANNEL].RPointer == g_CANx_SendBuffer.ch[TX_CHANNEL].WPointer);
+
+    printf("send ring,%s: %u frames taken by priority\n", name, (unsigned)(tx_count[0] + tx_count[1] + tx_count[2]));
+}
+
+
+
+/* XGATE thread:take the frames until the producer is done and the ring is empty */
+static void* tx_consumer(void* arg)
+{
+    int done;
+
+    (void)arg;
+
+    for (;;)
+    {
+        done = producer_done;
+
+        if (tx_consume() == 0)
+        {
+            if (done != 0)break;
+
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+
+
+static void tx_thread_test(void)
+{
+    pthread_t thread;
+
+    tx_start();
+
+    pthread_create(&thread, NULL, tx_consumer, NULL);
+
+    while (tx_seq < TX_FRAMES)
+    {
+        if (tx_produce() != 0)sched_yield();
+    }
+
+    producer_done = 1;
+
+    pthread_join(thread, NULL);
+
+    tx_finish("two threads");
+}
+
+
+
+/* The consumer runs after every store of the producer,once every 1,4,16 or 64 stores */
+static void tx_consumer_callback(volatile void* addr)
+{
+    uint32_t period = 1u << (((tx_seq / 500u) & 3u) * 2u);
+
+    (void)addr;
+
+    if ((tx_calls++ % period) == 0)(void)tx_consume();
+}
+
+
+
+/* The producer runs after every store of the consumer,a burst every 64 stores fills the ring */
+static void tx_producer_callback(volatile void* addr)
+{
+    uint8_t n = ((tx_calls++ & 63u) == 0) ? 40 : 1;
+
+    (void)addr;
+
+    for (; (n != 0) && (tx_seq < TRAP_FRAMES); n--)
+    {
+        if (tx_produce() != 0)break;
+    }
+}
+
+
+
+static void tx_trap_test(void)
+{
+    /* The producer is trapped,a full ring makes no store and the consumer goes on by itself. */
+    tx_start();
+
+    host_trap_start(&g_CANx_SendBuffer, sizeof(g_CANx_SendBuffer), tx_consumer_callback);
+
+    while (tx_seq < TRAP_FRAMES)
+    {
+        if (tx_produce() != 0)host_trap_run(tx_consume_one);
+    }
+
+    (void)host_trap_stop();
+
+    while (tx_consume() != 0);
+
+    tx_finish("consumer after every producer store");
+
+    /* The consumer is trapped,an empty ring makes no store and the producer goes on by itself. */
+    tx_start();
+
+    host_trap_start(&g_CANx_SendBuffer, sizeof(g_CANx_SendBuffer), tx_producer_callback);
+
+    while (tx_seq < TRAP_FRAMES)
+    {
+        if (tx_consume() == 0)host_trap_run(tx_produce_one);
+    }
+
+    (void)host_trap_stop();
+
+    while (tx_consume() != 0);
+
+    tx_finish("producer after every consumer store");
+}
+
+
+
+int main(void)
+{
+    rx_thread_test();
+
+    rx_trap_test();
+
+    tx_thread_test();
+
+    tx_trap_test();
+
+    return TEST_RESULT("test_spsc");
+}
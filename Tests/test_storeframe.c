@@ -0,0 +1,139 @@
+/*
+   Copy of a received frame from the foreground buffer into a packed frame.Every data length code
+   from 0 to 15 is stored with each ID format and frame type,and the slot is compared with a byte
+   by byte copy of the data length.
+*/
+#include "host_can.h"
+
+
+#define  CHANNEL            MSCAN_Channel0
+#define  FILL               (0xEEu)                /* Bytes of the slot before the frame is stored */
+
+
+
+/* The word copy alone,the destination keeps the bytes behind the rounded up length */
+static void copy_test(void)
+{
+    uint16_t dst_words[5];
+    uint8_t* dst = (uint8_t*)dst_words;
+    uint8_t  len,i;
+
+    volatile MSCAN_RegTypeDef* regs = host_regs(CHANNEL);
+
+    for (i = 0; i < 8; i++)regs->RXFG.DSR[i] = (uint8_t)(0x11u * (i + 1));
+
+    for (len = 0; len <= 8; len++)
+    {
+        memset(dst, FILL, sizeof(dst_words));
+
+        MSCAN_CopyDataSegment(dst, regs->RXFG.DSR, len);
+
+        for (i = 0; i < 10; i++)
+        {
+            if (i < ((len + 1u) & ~1u))TEST_CHECK(dst[i] == regs->RXFG.DSR[i]);
+            else TEST_CHECK(dst[i] == FILL);
+        }
+    }
+}
+
+
+
+/* Store a frame with every data length code,ID format and frame type */
+static void store_test(void)
+{
+    static const uint32_t std_id = 0x5A5u;
+    static const uint32_t ext_id = 0x1ABCDEF3u;
+
+    volatile CANFrame_TypeDef slot;
+    MSCAN_MessageTypeDef msg;
+
+    uint8_t data[8],dlc,ext,rtr,len,i;
+    uint32_t id,fid;
+
+    volatile MSCAN_RegTypeDef* regs = host_regs(CHANNEL);
+
+    for (i = 0; i < 8; i++)data[i] = (uint8_t)(0xA0u + i);
+
+    for (ext = 0; ext < 2; ext++)
+    {
+        for (rtr = 0; rtr < 2; rtr++)
+        {
+            for (dlc = 0; dlc < 16; dlc++)
+            {
+                id = ext ? ext_id : std_id;
+
+                host_rxfg_load(CHANNEL, ext, rtr, id, dlc, data);
+
+                /* The upper nibble of DLR is not part of the data length code. */
+                regs->RXFG.DLR = (uint8_t)(dlc | 0xF0u);
+
+                memset((void*)&slot, FILL, sizeof(slot));
+
+                fid = MSCAN_ReadFrameId(regs);
+
+                MSCAN_StoreFrame(regs, fid, &slot);
+
+                len = rtr ? 0 : ((dlc > 8) ? 8 : dlc);
+
+                TEST_CHECK(slot.id == fid);
+                TEST_CHECK(slot.dlc == len);
+
+                /* The data length is copied,an odd length may copy the next byte too. */
+                for (i = 0; i < 8; i++)
+                {
+                    if (i < len)TEST_CHECK(slot.data[i] == data[i]);
+                    else if ((i > len) || ((len & 1u) == 0))TEST_CHECK(slot.data[i] == FILL);
+                }
+
+                CAN_UnpackFrame(&slot, &msg);
+
+                TEST_CHECK(msg.frame_id == id);
+                TEST_CHECK(msg.data_length == len);
+                TEST_CHECK(msg.frametype == (ext ? (rtr ? RemoteFrameWithExtendedId : DataFrameWithExtendedId)
+                                                 : (rtr ? RemoteFrameWithStandardId : DataFrameWithStandardId)));
+            }
+        }
+    }
+}
+
+
+
+/* The same through the receive buffer */
+static void receive_test(void)
+{
+    MSCAN_MessageTypeDef msg;
+
+    uint8_t data[8],dlc,i;
+
+    CAN_MessageBuffer_Init();
+
+    for (dlc = 0; dlc < 16; dlc++)
+    {
+        for (i = 0; i < 8; i++)data[i] = (uint8_t)(dlc * 16u + i);
+
+        host_rxfg_load(CHANNEL, 1, 0, 0x10000000u | dlc, dlc, data);
+        host_regs(CHANNEL)->RFLG = 0x01u;
+
+        TEST_CHECK(MSCAN_ReceiveOneFrame(CHANNEL) == 1);
+
+        TEST_CHECK(Check_CANReceiveBuffer(CHANNEL, &msg) == 0);
+
+        TEST_CHECK(msg.frame_id == (0x10000000u | dlc));
+        TEST_CHECK(msg.data_length == ((dlc > 8) ? 8 : dlc));
+
+        for (i = 0; i < msg.data_length; i++)TEST_CHECK(msg.data[i] == data[i]);
+    }
+}
+
+
+
+int main(void)
+{
+    copy_test();
+
+    store_test();
+
+    receive_test();
+
+    return TEST_RESULT("test_storeframe");
+}